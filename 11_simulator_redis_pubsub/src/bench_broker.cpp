@@ -0,0 +1,203 @@
+////
+//// Load test for a pub/sub server over raw sockets: bin/broker or a real
+//// Redis (see `make bench-broker`).
+////
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+//
+// SUBSCRIBERS connections each subscribe to every channel; PUBLISHERS
+// threads pipeline PUBLISH commands BATCH at a time round-robin over the
+// channels and read the integer replies before the next batch. Payloads
+// all have the same size, so subscribers count deliveries by bytes
+// after their subscribe acks.
+//
+
+static int connect_to(const std::string& host, int port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    ::inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        std::cerr << "Cannot connect to " << host << ":" << port << ": " << std::strerror(errno) << std::endl;
+        std::exit(1);
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static bool write_all(int fd, const std::string& s) {
+    size_t off = 0;
+    while (off < s.size()) {
+        ssize_t w = ::write(fd, s.data() + off, s.size() - off);
+        if (w <= 0) return false;
+        off += w;
+    }
+    return true;
+}
+
+static std::string bulk(const std::string& s) {
+    return "$" + std::to_string(s.size()) + "\r\n" + s + "\r\n";
+}
+
+static std::string channel_name(int i) {
+    return "bench.broker." + std::to_string(i);
+}
+
+int main(int argc, char** argv) {
+    std::string host = "127.0.0.1";
+    int port = 6379;
+    int publishers = 2, subscribers = 8, channels = 4, batch = 256, payload = 64;
+    long long messages = 1000000;   // per publisher
+
+    static struct option long_options[] = {
+        {"host",        required_argument, 0, 'h'},
+        {"port",        required_argument, 0, 'p'},
+        {"publishers",  required_argument, 0, 'P'},
+        {"subscribers", required_argument, 0, 'S'},
+        {"channels",    required_argument, 0, 'c'},
+        {"messages",    required_argument, 0, 'n'},
+        {"batch",       required_argument, 0, 'b'},
+        {"payload",     required_argument, 0, 'l'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    int option_index = 0;
+    while ((opt = getopt_long(argc, argv, "h:p:P:S:c:n:b:l:", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'h': host = optarg; break;
+            case 'p': port = std::atoi(optarg); break;
+            case 'P': publishers = std::atoi(optarg); break;
+            case 'S': subscribers = std::atoi(optarg); break;
+            case 'c': channels = std::max(1, std::atoi(optarg)); break;
+            case 'n': messages = std::atoll(optarg); break;
+            case 'b': batch = std::max(1, std::atoi(optarg)); break;
+            case 'l': payload = std::max(1, std::atoi(optarg)); break;
+            default:
+                std::cerr << "Usage: " << argv[0] << " [--host H] [--port P] [--publishers N] [--subscribers N]"
+                          << " [--channels N] [--messages N] [--batch N] [--payload BYTES]" << std::endl;
+                return 1;
+        }
+    }
+
+    // Frame size per channel (names differ in length past 10 channels)
+    std::string msg(payload, 'x');
+    std::vector<size_t> frame_size(channels);
+    for (int c = 0; c < channels; ++c)
+        frame_size[c] = ("*3\r\n" + bulk("message") + bulk(channel_name(c)) + bulk(msg)).size();
+
+    // Subscribe and wait for all acks before publishing anything
+    std::vector<int> sub_fds;
+    std::string sub_cmd = "*" + std::to_string(channels + 1) + "\r\n" + bulk("SUBSCRIBE");
+    size_t ack_bytes = 0;
+    for (int c = 0; c < channels; ++c) {
+        sub_cmd += bulk(channel_name(c));
+        ack_bytes += ("*3\r\n" + bulk("subscribe") + bulk(channel_name(c)) + ":" + std::to_string(c + 1) + "\r\n").size();
+    }
+    std::vector<char> buf(1 << 16);
+    for (int s = 0; s < subscribers; ++s) {
+        int fd = connect_to(host, port);
+        write_all(fd, sub_cmd);
+        size_t got = 0;
+        while (got < ack_bytes) {
+            ssize_t r = ::read(fd, buf.data(), std::min(buf.size(), ack_bytes - got));
+            if (r <= 0) {
+                std::cerr << "Subscriber " << s << " lost its connection" << std::endl;
+                return 1;
+            }
+            got += r;
+        }
+        sub_fds.push_back(fd);
+    }
+
+    // Bytes each subscriber should receive in total
+    uint64_t expected_bytes = 0;
+    for (int p = 0; p < publishers; ++p)
+        for (long long i = 0; i < messages; ++i) expected_bytes += frame_size[(p + i) % channels];
+
+    std::atomic<uint64_t> delivered_bytes{0};
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<double> sub_done(subscribers, 0.0);
+
+    for (int s = 0; s < subscribers; ++s) {
+        threads.emplace_back([&, s] {
+            std::vector<char> rbuf(1 << 16);
+            uint64_t got = 0;
+            while (got < expected_bytes) {
+                ssize_t r = ::read(sub_fds[s], rbuf.data(), rbuf.size());
+                if (r <= 0) break;
+                got += r;
+            }
+            delivered_bytes += got;
+            sub_done[s] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        });
+    }
+
+    std::vector<double> pub_done(publishers, 0.0);
+    for (int p = 0; p < publishers; ++p) {
+        threads.emplace_back([&, p] {
+            int fd = connect_to(host, port);
+            std::vector<char> rbuf(1 << 16);
+            std::string out;
+            long long sent = 0;
+            while (sent < messages) {
+                int n = static_cast<int>(std::min<long long>(batch, messages - sent));
+                out.clear();
+                for (int i = 0; i < n; ++i)
+                    out += "*3\r\n" + bulk("PUBLISH") + bulk(channel_name((p + sent + i) % channels)) + bulk(msg);
+                if (!write_all(fd, out)) break;
+                // One ":<count>\r\n" reply per command
+                int replies = 0;
+                while (replies < n) {
+                    ssize_t r = ::read(fd, rbuf.data(), rbuf.size());
+                    if (r <= 0) {
+                        ::close(fd);
+                        return;
+                    }
+                    for (ssize_t i = 0; i < r; ++i)
+                        if (rbuf[i] == '\n') ++replies;
+                }
+                sent += n;
+            }
+            ::close(fd);
+            pub_done[p] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        });
+    }
+
+    for (auto& t : threads) t.join();
+    for (int fd : sub_fds) ::close(fd);
+
+    double pub_secs = 0, secs = 0;
+    for (double d : pub_done) pub_secs = std::max(pub_secs, d);
+    for (double d : sub_done) secs = std::max(secs, d);
+    secs = std::max(secs, pub_secs);
+    long long published = publishers * messages;
+    uint64_t expected_total = expected_bytes * subscribers;
+    double delivered = published * static_cast<double>(subscribers) * delivered_bytes / std::max<uint64_t>(1, expected_total);
+
+    std::printf("%d publishers x %lld messages (%d bytes, batch %d) to %d subscribers on %d channels\n",
+                publishers, messages, payload, batch, subscribers, channels);
+    std::printf("  publish:  %.0f msg/s (%.3f s)\n", published / pub_secs, pub_secs);
+    std::printf("  delivery: %.0f msg/s, %.1f MB/s (%.3f s)%s\n", delivered / secs,
+                delivered_bytes / secs / 1e6, secs,
+                delivered_bytes == expected_total ? "" : "  [INCOMPLETE: a subscriber was disconnected]");
+    return delivered_bytes == expected_total ? 0 : 1;
+}
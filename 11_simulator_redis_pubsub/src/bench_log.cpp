@@ -0,0 +1,48 @@
+////
+//// Cost of logging on the per-message path, without Redis.
+//// Build once per FMF_LOG_LEVEL (see `make bench-logging`).
+////
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "coalesce.h"
+#include "log.h"
+#include "trace.h"
+
+int main(int argc, char** argv) {
+    int n = argc >= 2 ? std::atoi(argv[1]) : 1000000;
+    const int clients = 10000;
+
+    CoalescingBuffer buffer;
+    std::vector<std::pair<int, std::string>> batch;
+    char buf[96];
+    size_t forwarded = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i) {
+        // What server_ingest + server_forward do per message, minus Redis
+        int id = i % clients;
+        int len = std::snprintf(buf, sizeof(buf), "%d,%g,%g,%lld", id, 10.0f + i * 0.1f, 20.0f + i * 0.1f,
+                                static_cast<long long>(now_us()));
+        std::string msg(buf, len);
+        FMF_LOG_DEBUG("[bench] Received: " << msg);
+        buffer.put(id, std::move(msg));
+
+        if (i % 1000 == 999) {
+            buffer.drain(batch);
+            for (auto& update : batch) {
+                FMF_LOG_INFO_SAMPLED("[bench] Forwarded: " << update.second);
+                ++forwarded;
+            }
+        }
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const char* sample = std::getenv("FMF_LOG_SAMPLE");
+    std::fprintf(stderr, "FMF_LOG_LEVEL=%d FMF_LOG_SAMPLE=%s: %d messages (%zu forwarded) in %.3f s = %.0f msg/s\n",
+                 FMF_LOG_LEVEL, sample ? sample : "1", n, forwarded, secs, n / secs);
+    return 0;
+}
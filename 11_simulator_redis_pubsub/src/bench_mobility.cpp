@@ -0,0 +1,33 @@
+////
+//// Speed of the mobility model on one core, without Redis
+//// (see `make bench-mobility`).
+////
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "mobility.h"
+
+int main(int argc, char** argv) {
+    size_t n = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    int ticks = argc >= 3 ? std::atoi(argv[2]) : 200;
+    const float dt = 0.1f;   // the load generator moves people every 100 ms
+
+    for (MobilityMode mode : {MobilityMode::RANDOM_WAYPOINT, MobilityMode::MANHATTAN}) {
+        MobilityParams p;
+        p.mode = mode;
+        Mobility people(n, p);
+
+        size_t arrivals = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < ticks; ++t) arrivals += people.step(dt);
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("%-15s %zu people x %d ticks in %.3f s = %.0f M people-steps/s (%.2f ms/tick, %zu arrivals)"
+                    " first at %.6f,%.6f\n",
+                    mode == MobilityMode::MANHATTAN ? "manhattan" : "random-waypoint", n, ticks, secs,
+                    n * ticks / secs / 1e6, secs * 1000 / ticks, arrivals, people.lat(0), people.lon(0));
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+////
+//// Throughput of the two ingest -> forward transports against a local Redis:
+//// pub/sub (PUBLISH + SUBSCRIBE) vs streams (XADD + XREADGROUP/XACK)
+////
+
+#include <cpp_redis/cpp_redis>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "streams.h"
+
+// Commands per pipelined commit on the producer side
+static const int BATCH = 1000;
+
+static double seconds_since(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+static std::string payload(int i) {
+    return std::to_string(i % 100000) + ",10.5,20.5";
+}
+
+static void report(const char* name, int sent, int received, double secs) {
+    std::cout << name << ": " << received << "/" << sent << " messages in " << secs << " s = "
+              << static_cast<long>(received / secs) << " msg/s" << std::endl;
+}
+
+static void bench_pubsub(int n) {
+    const std::string channel = "bench.pubsub";
+    std::atomic<int> received{0};
+    std::atomic<int64_t> last_arrival{0};   // steady_clock ticks
+
+    cpp_redis::subscriber sub;
+    sub.connect("127.0.0.1", 6379);
+    sub.subscribe(channel, [&](const std::string&, const std::string&) {
+        last_arrival = std::chrono::steady_clock::now().time_since_epoch().count();
+        ++received;
+    });
+    sub.commit();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));   // let SUBSCRIBE land
+
+    cpp_redis::client pub;
+    pub.connect("127.0.0.1", 6379);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i) {
+        pub.publish(channel, payload(i), nullptr);
+        if ((i + 1) % BATCH == 0) pub.commit();
+    }
+    pub.sync_commit();
+
+    // Pub/sub drops what a slow subscriber can't take, so stop waiting
+    // once nothing has arrived for a second. The clock stops at the last
+    // arrival, not when we gave up waiting.
+    int last = received;
+    auto last_change = std::chrono::steady_clock::now();
+    while (received < n && std::chrono::steady_clock::now() - last_change < std::chrono::seconds(1)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        if (received != last) {
+            last = received;
+            last_change = std::chrono::steady_clock::now();
+        }
+    }
+    auto end = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(last_arrival.load()));
+    report("pubsub ", n, received, received ? std::chrono::duration<double>(end - start).count() : seconds_since(start));
+
+    sub.unsubscribe(channel);
+    sub.disconnect();
+    pub.disconnect();
+}
+
+static void bench_streams(int n, int count) {
+    const std::string key = "bench.stream";
+    const std::string group = "bench";
+
+    cpp_redis::client producer, consumer;
+    producer.connect("127.0.0.1", 6379);
+    consumer.connect("127.0.0.1", 6379);
+
+    producer.send({"DEL", key}, nullptr);
+    producer.sync_commit();
+    ensure_group(consumer, key, group);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread writer([&]() {
+        for (int i = 0; i < n; ++i) {
+            producer.send(xadd_cmd(key, payload(i)), nullptr);
+            if ((i + 1) % BATCH == 0) producer.commit();
+        }
+        producer.sync_commit();
+    });
+
+    // Read in batches, ack each batch with one XACK, and check nothing
+    // was lost or reordered
+    int received = 0, out_of_order = 0;
+    std::vector<StreamEntry> entries;
+    std::vector<std::string> ids;
+    while (received < n) {
+        read_group(consumer, key, group, "bench-consumer", ">", count, 1000, entries);
+        if (entries.empty()) break;
+        ids.clear();
+        for (auto& e : entries) {
+            if (e.msg != payload(received)) ++out_of_order;
+            ids.push_back(e.id);
+            ++received;
+        }
+        consumer.send(xack_cmd(key, group, ids), nullptr);
+        consumer.commit();
+    }
+    writer.join();
+    consumer.sync_commit();
+    report("streams", n, received, seconds_since(start));
+    if (out_of_order) std::cout << "streams: " << out_of_order << " messages out of order!" << std::endl;
+
+    producer.send({"DEL", key}, nullptr);
+    producer.sync_commit();
+    producer.disconnect();
+    consumer.disconnect();
+}
+
+int main(int argc, char** argv) {
+    int n = argc >= 2 ? std::atoi(argv[1]) : 200000;
+    int count = argc >= 3 ? std::atoi(argv[2]) : 256;
+
+    std::cout << "Benchmarking " << n << " messages (XREADGROUP COUNT " << count << ")" << std::endl;
+    try {
+        bench_pubsub(n);
+        bench_streams(n, count);
+    } catch (const cpp_redis::redis_error &e) {
+        std::cerr << "Redis error: " << e.what() << " (is redis-server running?)" << std::endl;
+        return 1;
+    }
+    return 0;
+}
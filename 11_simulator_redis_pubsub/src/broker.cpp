@@ -0,0 +1,524 @@
+////
+//// Stand-in for Redis on hosts without one: a single-threaded pub/sub
+//// broker speaking enough RESP for cpp_redis (Linux, epoll)
+////
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "log.h"
+
+//
+// Supported: SUBSCRIBE, UNSUBSCRIBE, PSUBSCRIBE, PUNSUBSCRIBE, PUBLISH,
+// PING, ECHO, QUIT, in RESP arrays or inline, pipelined. Anything else
+// (XADD, ...) gets an error reply, so the streams transport still needs
+// a real Redis.
+//
+// A published message is framed once into a shared buffer; every
+// subscriber's output queue holds a reference to it, and queues are
+// written with writev once per loop iteration, so fan-out copies no
+// payload bytes. A subscriber whose queue grows past --max-output-mb is
+// disconnected, like Redis' client-output-buffer-limit for pub/sub.
+//
+
+std::atomic<bool> running{true};
+
+void signal_handler(int) {
+    running = false;
+}
+
+typedef std::shared_ptr<const std::string> Buffer;
+
+struct Chunk {
+    Buffer buf;
+    size_t off;
+};
+
+struct Conn {
+    int fd;
+    std::string in;               // received, not yet parsed
+    std::string reply;            // replies produced while parsing one read
+    std::deque<Chunk> out;        // waiting to be written
+    size_t out_bytes = 0;
+    std::vector<std::string> channels, patterns;
+    bool dirty = false;           // has output to flush this iteration
+    bool writable_wait = false;   // registered for EPOLLOUT
+    bool closing = false;
+};
+
+// Redis-style glob: '*', '?' and literal characters
+static bool glob_match(const char* p, const char* pend, const char* s, const char* send) {
+    while (p < pend) {
+        if (*p == '*') {
+            for (const char* t = s; t <= send; ++t)
+                if (glob_match(p + 1, pend, t, send)) return true;
+            return false;
+        }
+        if (s == send || (*p != '?' && *p != *s)) return false;
+        ++p;
+        ++s;
+    }
+    return s == send;
+}
+
+static bool equals_ci(const std::string& a, const char* b) {
+    size_t n = std::strlen(b);
+    if (a.size() != n) return false;
+    for (size_t i = 0; i < n; ++i)
+        if (std::toupper(static_cast<unsigned char>(a[i])) != b[i]) return false;
+    return true;
+}
+
+static void append_bulk(std::string& out, const std::string& s) {
+    out += '$';
+    out += std::to_string(s.size());
+    out += "\r\n";
+    out += s;
+    out += "\r\n";
+}
+
+static void append_int(std::string& out, long long v) {
+    out += ':';
+    out += std::to_string(v);
+    out += "\r\n";
+}
+
+class Broker {
+public:
+    Broker(size_t max_output) : max_output_(max_output) {}
+
+    bool listen_on(const std::string& host, int port) {
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        int one = 1;
+        ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+            ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listen_fd_, 1024) != 0) {
+            FMF_LOG_ERROR("[broker] Cannot listen on " << host << ":" << port << ": " << std::strerror(errno));
+            return false;
+        }
+        epoll_fd_ = ::epoll_create1(0);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = listen_fd_;
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+        return true;
+    }
+
+    void run(int stats_interval) {
+        std::vector<epoll_event> events(1024);
+        std::vector<char> rbuf(64 * 1024);
+        auto last_stats = std::chrono::steady_clock::now();
+        uint64_t last_published = 0;
+
+        while (running) {
+            int n = ::epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), 200);
+            for (int i = 0; i < n; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == listen_fd_) {
+                    accept_all();
+                    continue;
+                }
+                auto it = conns_.find(fd);
+                if (it == conns_.end()) continue;
+                Conn& c = *it->second;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) on_readable(c, rbuf);
+                if ((events[i].events & EPOLLOUT) && !c.closing) mark_dirty(c);
+            }
+
+            // One writev per connection with output, however many
+            // messages were fanned out to it in this iteration
+            for (Conn* c : dirty_) {
+                c->dirty = false;
+                if (!c->closing) flush(*c);
+            }
+            dirty_.clear();
+            for (int fd : to_close_) close_conn(fd);
+            to_close_.clear();
+
+            auto now = std::chrono::steady_clock::now();
+            if (stats_interval > 0 && now - last_stats >= std::chrono::seconds(stats_interval)) {
+                double secs = std::chrono::duration<double>(now - last_stats).count();
+                FMF_LOG_INFO("[broker] " << conns_.size() << " connections, " << channels_.size() << " channels, "
+                          << static_cast<uint64_t>((published_ - last_published) / secs) << " publishes/s, "
+                          << delivered_ << " delivered, " << dropped_ << " slow subscribers dropped");
+                last_published = published_;
+                last_stats = now;
+            }
+        }
+        for (auto& kv : conns_) ::close(kv.first);
+        ::close(listen_fd_);
+        ::close(epoll_fd_);
+    }
+
+private:
+    void accept_all() {
+        for (;;) {
+            int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK);
+            if (fd < 0) return;
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            std::unique_ptr<Conn> c(new Conn);
+            c->fd = fd;
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+            conns_[fd] = std::move(c);
+        }
+    }
+
+    void on_readable(Conn& c, std::vector<char>& rbuf) {
+        for (;;) {
+            ssize_t r = ::read(c.fd, rbuf.data(), rbuf.size());
+            if (r > 0) {
+                c.in.append(rbuf.data(), r);
+                if (static_cast<size_t>(r) < rbuf.size()) break;
+                continue;
+            }
+            if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (r < 0 && errno == EINTR) continue;
+            schedule_close(c);   // EOF or error
+            return;
+        }
+        parse(c);
+        if (!c.reply.empty()) {
+            enqueue(c, std::make_shared<const std::string>(std::move(c.reply)));
+            c.reply.clear();
+        }
+    }
+
+    // Execute every complete command in c.in
+    void parse(Conn& c) {
+        size_t pos = 0;
+        std::vector<std::string> args;
+        while (pos < c.in.size() && !c.closing) {
+            size_t start = pos;
+            args.clear();
+            int r = c.in[pos] == '*' ? parse_array(c.in, pos, args) : parse_inline(c.in, pos, args);
+            if (r == 0) {
+                pos = start;   // incomplete, wait for more
+                break;
+            }
+            if (r < 0) {
+                c.reply += "-ERR Protocol error\r\n";
+                schedule_close(c);
+                break;
+            }
+            if (!args.empty()) execute(c, args);
+        }
+        c.in.erase(0, pos);
+    }
+
+    // 1 = parsed, 0 = need more bytes, -1 = malformed
+    static int parse_array(const std::string& in, size_t& pos, std::vector<std::string>& args) {
+        long long count;
+        int r = parse_number(in, pos, '*', count);
+        if (r <= 0) return r;
+        if (count < 0 || count > 1024 * 1024) return -1;
+        for (long long i = 0; i < count; ++i) {
+            long long len;
+            r = parse_number(in, pos, '$', len);
+            if (r <= 0) return r;
+            if (len < 0 || len > 512LL * 1024 * 1024) return -1;
+            if (in.size() - pos < static_cast<size_t>(len) + 2) return 0;
+            args.emplace_back(in, pos, static_cast<size_t>(len));
+            pos += len + 2;
+        }
+        return 1;
+    }
+
+    static int parse_number(const std::string& in, size_t& pos, char prefix, long long& v) {
+        if (pos >= in.size()) return 0;
+        if (in[pos] != prefix) return -1;
+        size_t eol = in.find("\r\n", pos);
+        if (eol == std::string::npos) return in.size() - pos > 32 ? -1 : 0;
+        char* end;
+        v = std::strtoll(in.c_str() + pos + 1, &end, 10);
+        if (end != in.c_str() + eol) return -1;
+        pos = eol + 2;
+        return 1;
+    }
+
+    static int parse_inline(const std::string& in, size_t& pos, std::vector<std::string>& args) {
+        size_t eol = in.find('\n', pos);
+        if (eol == std::string::npos) return in.size() - pos > 64 * 1024 ? -1 : 0;
+        size_t end = eol > pos && in[eol - 1] == '\r' ? eol - 1 : eol;
+        size_t i = pos;
+        while (i < end) {
+            while (i < end && in[i] == ' ') ++i;
+            size_t j = i;
+            while (j < end && in[j] != ' ') ++j;
+            if (j > i) args.emplace_back(in, i, j - i);
+            i = j;
+        }
+        pos = eol + 1;
+        return 1;
+    }
+
+    void execute(Conn& c, const std::vector<std::string>& args) {
+        const std::string& cmd = args[0];
+        if (equals_ci(cmd, "PUBLISH") && args.size() == 3) {
+            append_int(c.reply, publish(args[1], args[2]));
+        } else if (equals_ci(cmd, "SUBSCRIBE") && args.size() >= 2) {
+            for (size_t i = 1; i < args.size(); ++i) subscribe(c, args[i], false);
+        } else if (equals_ci(cmd, "PSUBSCRIBE") && args.size() >= 2) {
+            for (size_t i = 1; i < args.size(); ++i) subscribe(c, args[i], true);
+        } else if (equals_ci(cmd, "UNSUBSCRIBE")) {
+            unsubscribe(c, std::vector<std::string>(args.begin() + 1, args.end()), false);
+        } else if (equals_ci(cmd, "PUNSUBSCRIBE")) {
+            unsubscribe(c, std::vector<std::string>(args.begin() + 1, args.end()), true);
+        } else if (equals_ci(cmd, "PING")) {
+            if (args.size() > 1) append_bulk(c.reply, args[1]);
+            else c.reply += "+PONG\r\n";
+        } else if (equals_ci(cmd, "ECHO") && args.size() == 2) {
+            append_bulk(c.reply, args[1]);
+        } else if (equals_ci(cmd, "QUIT")) {
+            c.reply += "+OK\r\n";
+            schedule_close(c);
+        } else {
+            c.reply += "-ERR unknown command or wrong number of arguments for '" + cmd + "' (broker)\r\n";
+        }
+    }
+
+    long long publish(const std::string& channel, const std::string& msg) {
+        ++published_;
+        long long receivers = 0;
+        auto it = channels_.find(channel);
+        if (it != channels_.end() && !it->second.empty()) {
+            std::string frame = "*3\r\n$7\r\nmessage\r\n";
+            append_bulk(frame, channel);
+            append_bulk(frame, msg);
+            Buffer buf = std::make_shared<const std::string>(std::move(frame));
+            for (Conn* s : it->second)
+                if (!s->closing) receivers += enqueue(*s, buf);
+        }
+        for (auto& p : patterns_) {
+            if (p.second.empty() ||
+                !glob_match(p.first.data(), p.first.data() + p.first.size(), channel.data(), channel.data() + channel.size()))
+                continue;
+            std::string frame = "*4\r\n$8\r\npmessage\r\n";
+            append_bulk(frame, p.first);
+            append_bulk(frame, channel);
+            append_bulk(frame, msg);
+            Buffer buf = std::make_shared<const std::string>(std::move(frame));
+            for (Conn* s : p.second)
+                if (!s->closing) receivers += enqueue(*s, buf);
+        }
+        delivered_ += receivers;
+        return receivers;
+    }
+
+    void subscribe(Conn& c, const std::string& name, bool pattern) {
+        std::vector<std::string>& mine = pattern ? c.patterns : c.channels;
+        if (std::find(mine.begin(), mine.end(), name) == mine.end()) {
+            mine.push_back(name);
+            subscribers(name, pattern).push_back(&c);
+        }
+        ack(c, pattern ? "psubscribe" : "subscribe", name);
+    }
+
+    void unsubscribe(Conn& c, std::vector<std::string> names, bool pattern) {
+        std::vector<std::string>& mine = pattern ? c.patterns : c.channels;
+        const char* kind = pattern ? "punsubscribe" : "unsubscribe";
+        if (names.empty()) {
+            names = mine;
+            if (names.empty()) {
+                // Nothing to leave: Redis still acknowledges with a nil name
+                c.reply += "*3\r\n$" + std::to_string(std::strlen(kind)) + "\r\n" + kind + "\r\n$-1\r\n";
+                append_int(c.reply, subscription_count(c));
+                return;
+            }
+        }
+        for (auto& name : names) {
+            auto mit = std::find(mine.begin(), mine.end(), name);
+            if (mit != mine.end()) {
+                mine.erase(mit);
+                remove_subscriber(name, pattern, &c);
+            }
+            ack(c, kind, name);
+        }
+    }
+
+    void ack(Conn& c, const char* kind, const std::string& name) {
+        c.reply += "*3\r\n";
+        append_bulk(c.reply, kind);
+        append_bulk(c.reply, name);
+        append_int(c.reply, subscription_count(c));
+    }
+
+    static long long subscription_count(const Conn& c) {
+        return static_cast<long long>(c.channels.size() + c.patterns.size());
+    }
+
+    std::vector<Conn*>& subscribers(const std::string& name, bool pattern) {
+        if (!pattern) return channels_[name];
+        for (auto& p : patterns_)
+            if (p.first == name) return p.second;
+        patterns_.emplace_back(name, std::vector<Conn*>());
+        return patterns_.back().second;
+    }
+
+    void remove_subscriber(const std::string& name, bool pattern, Conn* c) {
+        std::vector<Conn*>& subs = subscribers(name, pattern);
+        subs.erase(std::remove(subs.begin(), subs.end(), c), subs.end());
+        if (subs.empty() && !pattern) channels_.erase(name);
+    }
+
+    // Returns 1 if queued for c, 0 if that made c a slow subscriber.
+    // A closing connection still takes its last replies (QUIT, errors),
+    // which close_conn() flushes.
+    int enqueue(Conn& c, const Buffer& buf) {
+        c.out.push_back(Chunk{buf, 0});
+        c.out_bytes += buf->size();
+        if (c.out_bytes > max_output_) {
+            if (!c.closing) {
+                FMF_LOG_WARN("[broker] Dropping slow subscriber fd " << c.fd << ": " << c.out_bytes << " bytes queued");
+                ++dropped_;
+                schedule_close(c);
+            }
+            return 0;
+        }
+        mark_dirty(c);
+        return 1;
+    }
+
+    void mark_dirty(Conn& c) {
+        if (!c.dirty) {
+            c.dirty = true;
+            dirty_.push_back(&c);
+        }
+    }
+
+    void flush(Conn& c) {
+        static const int MAX_IOV = 256;
+        iovec iov[MAX_IOV];
+        while (!c.out.empty()) {
+            int n = 0;
+            for (auto it = c.out.begin(); it != c.out.end() && n < MAX_IOV; ++it, ++n) {
+                iov[n].iov_base = const_cast<char*>(it->buf->data()) + it->off;
+                iov[n].iov_len = it->buf->size() - it->off;
+            }
+            ssize_t w = ::writev(c.fd, iov, n);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                schedule_close(c);
+                return;
+            }
+            c.out_bytes -= w;
+            size_t left = static_cast<size_t>(w);
+            while (left > 0) {
+                Chunk& front = c.out.front();
+                size_t rest = front.buf->size() - front.off;
+                if (left < rest) {
+                    front.off += left;
+                    break;
+                }
+                left -= rest;
+                c.out.pop_front();
+            }
+        }
+        // Ask for EPOLLOUT only while the socket is full
+        bool want = !c.out.empty();
+        if (want != c.writable_wait) {
+            epoll_event ev{};
+            ev.events = want ? uint32_t(EPOLLIN | EPOLLOUT) : uint32_t(EPOLLIN);
+            ev.data.fd = c.fd;
+            ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c.fd, &ev);
+            c.writable_wait = want;
+        }
+    }
+
+    void schedule_close(Conn& c) {
+        if (c.closing) return;
+        c.closing = true;
+        to_close_.push_back(c.fd);
+    }
+
+    void close_conn(int fd) {
+        auto it = conns_.find(fd);
+        if (it == conns_.end()) return;
+        Conn& c = *it->second;
+        // Best effort for a final reply (QUIT, protocol error)
+        if (c.out_bytes <= max_output_) flush(c);
+        for (auto& ch : c.channels) remove_subscriber(ch, false, &c);
+        for (auto& p : c.patterns) remove_subscriber(p, true, &c);
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        conns_.erase(it);
+    }
+
+    size_t max_output_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    std::unordered_map<int, std::unique_ptr<Conn>> conns_;
+    std::unordered_map<std::string, std::vector<Conn*>> channels_;
+    std::vector<std::pair<std::string, std::vector<Conn*>>> patterns_;
+    std::vector<Conn*> dirty_;
+    std::vector<int> to_close_;
+    uint64_t published_ = 0, delivered_ = 0, dropped_ = 0;
+};
+
+int main(int argc, char** argv) {
+    std::string host = "127.0.0.1";
+    int port = 6379;
+    long max_output_mb = 32;
+    int stats_interval = 5;
+
+    static struct option long_options[] = {
+        {"bind",           required_argument, 0, 'b'},
+        {"port",           required_argument, 0, 'p'},
+        {"max-output-mb",  required_argument, 0, 'm'},
+        {"stats-interval", required_argument, 0, 's'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    int option_index = 0;
+    while ((opt = getopt_long(argc, argv, "b:p:m:s:", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'b': host = optarg; break;
+            case 'p': port = std::atoi(optarg); break;
+            case 'm': max_output_mb = std::atol(optarg); break;
+            case 's': stats_interval = std::atoi(optarg); break;
+            default:
+                std::cerr << "Usage: " << argv[0] << " [--bind ADDR] [--port P] [--max-output-mb MB] [--stats-interval S]" << std::endl;
+                return 1;
+        }
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    Broker broker(static_cast<size_t>(std::max(1L, max_output_mb)) << 20);
+    if (!broker.listen_on(host, port)) return 1;
+    FMF_LOG_INFO("[broker] Listening on " << host << ":" << port << " (pub/sub only)");
+    broker.run(stats_interval);
+    FMF_LOG_INFO("[broker] Shutting down.");
+    return 0;
+}
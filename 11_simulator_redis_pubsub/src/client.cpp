@@ -9,6 +9,19 @@
 #include <chrono>
 #include <csignal>
 #include <atomic>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+#include <getopt.h>
+#include "coalesce.h"
+#include "delta.h"
+#include "log.h"
+#include "mobility.h"
+#include "reconnect.h"
+#include "shard.h"
+#include "timer_wheel.h"
+#include "trace.h"
 
 std::atomic<bool> running{true};
 
@@ -16,62 +29,242 @@ void signal_handler(int) {
     running = false;
 }
 
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <client_id>" << std::endl;
-        return 1;
+// Updates per pipelined commit when draining the pending buffer
+static const size_t DRAIN_BATCH = 1000;
+// How often the load generator moves everybody
+static const int MOVE_MS = 100;
+
+//
+// What actually goes on the wire: the text update as is, or (with --delta)
+// a keyframe/delta frame from that client's encoder. Encoding happens at
+// send time, so updates coalesced away while disconnected never consume a
+// sequence number. Counts bytes per update.
+//
+struct Wire {
+    Wire(bool delta, int num_clients, int keyframe_every)
+        : delta(delta), encoders(delta ? num_clients : 0, DeltaEncoder(keyframe_every)) {}
+
+    bool delta;
+    std::vector<DeltaEncoder> encoders;
+    std::string frame;
+    uint64_t bytes = 0, updates = 0;
+
+    // `text` is "id,lat,lon,t_send"; index picks the encoder
+    const std::string& payload(int index, const std::string& text) {
+        ++updates;
+        if (!delta) {
+            bytes += text.size();
+            return text;
+        }
+        int id;
+        double lat, lon;
+        long long t_send;
+        std::sscanf(text.c_str(), "%d,%lf,%lf,%lld", &id, &lat, &lon, &t_send);
+        frame.clear();
+        encoders[index].encode(id, lat, lon, t_send, frame);
+        bytes += frame.size();
+        return frame;
     }
 
-    int id = std::stoi(argv[1]);
-    std::cout << "[client" << id << "] Starting up..." << std::endl;
-    std::cout.flush();
+    double bytes_per_update() const { return updates ? double(bytes) / updates : 0.0; }
+};
 
-    signal(SIGINT, signal_handler);
+//
+// Load generator: simulate `num_clients` people in this one process.
+//
+// Every simulated client has a timer in a hierarchical timer wheel (1 tick
+// = 1 ms). When it fires we put the person's current position in the
+// pending buffer of one of a few pooled connections and re-arm the timer.
+// Everybody moves every MOVE_MS (mobility.h). After each tick every
+// connected connection drains its buffer in pipelined batches. While a
+// connection is down its buffer keeps only the latest update per client,
+// so nothing grows without bound.
+//
+static int run_load(int num_clients, int first_id, int num_conns, int interval_ms, MobilityMode mode, Wire& wire) {
+    FMF_LOG_INFO("[load] Simulating " << num_clients << " clients on " << num_conns
+              << " connections, one update every " << interval_ms << " ms each");
+
+    std::vector<std::unique_ptr<ReconnectingClient>> pool;
+    std::vector<std::unique_ptr<CoalescingBuffer>> pending;
+    for (int i = 0; i < num_conns; ++i) {
+        pool.emplace_back(new ReconnectingClient("load" + std::to_string(i)));
+        pool.back()->start();
+        pending.emplace_back(new CoalescingBuffer(num_clients / num_conns + 1));
+    }
+    std::vector<std::pair<int, std::string>> scratch;
 
-    cpp_redis::client redis_client;
+    // Channel names per shard, built once
+    std::vector<std::string> channels;
+    for (int s = 0; s < NUM_SHARDS; ++s) channels.push_back(shard_channel(s));
+    auto send = [&](cpp_redis::client& c, const std::string& msg, const cpp_redis::reply_callback_t& done) {
+        int client_id = std::atoi(msg.c_str());
+        c.publish(channels[shard_of(client_id)], wire.payload(client_id - first_id, msg), done);
+    };
+
+    // Positions, structure-of-arrays
+    MobilityParams params;
+    params.mode = mode;
+    Mobility people(num_clients, params, 12345 + first_id);
+    TimerWheel<uint32_t> wheel;
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> phase(1, interval_ms);
+    for (int i = 0; i < num_clients; ++i) {
+        // Spread first updates over one interval so we don't burst
+        wheel.schedule(phase(rng), static_cast<uint32_t>(i));
+    }
+    uint64_t last_move = 0;
+
+    uint64_t sent = 0, last_sent = 0;
+    char buf[96];
+    auto start = std::chrono::steady_clock::now();
+    auto last_report = start;
 
-    // Retry connecting to Redis until successful
     while (running) {
-        try {
-            redis_client.connect("127.0.0.1", 6379);
-            std::cout << "[client" << id << "] Connected to Redis." << std::endl;
-            std::cout.flush();
-            break;
-        } catch (const cpp_redis::redis_error &e) {
-            std::cerr << "[client" << id << "] Redis not ready, retrying in 1s..." << std::endl;
-            std::cerr.flush();
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+        auto now = std::chrono::steady_clock::now();
+        uint64_t tick = std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
+
+        if (tick - last_move >= static_cast<uint64_t>(MOVE_MS)) {
+            people.step((tick - last_move) / 1000.0f);
+            last_move = tick;
+        }
+
+        wheel.advance_to(tick, [&](uint32_t i) {
+            int conn = i % num_conns;
+            int client_id = first_id + static_cast<int>(i);
+            int len = std::snprintf(buf, sizeof(buf), "%d,%.6f,%.6f,%lld", client_id, people.lat(i), people.lon(i),
+                                    static_cast<long long>(now_us()));
+            pending[conn]->put(client_id, std::string(buf, len));
+            wheel.schedule(interval_ms, i);
+        });
+
+        for (int c = 0; c < num_conns; ++c)
+            sent += drain_pending(*pool[c], *pending[c], scratch, DRAIN_BATCH, send);
+
+        if (now - last_report >= std::chrono::seconds(1)) {
+            double secs = std::chrono::duration<double>(now - last_report).count();
+            size_t buffered = 0;
+            uint64_t coalesced = 0;
+            for (auto& p : pending) {
+                buffered += p->size();
+                coalesced += p->stats().coalesced;
+            }
+            FMF_LOG_INFO("[load] " << static_cast<uint64_t>((sent - last_sent) / secs) << " updates/s, "
+                      << sent << " sent, " << buffered << " buffered, " << coalesced << " coalesced, "
+                      << wire.bytes_per_update() << " bytes/update");
+            last_sent = sent;
+            last_report = now;
         }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
 
+    for (auto& c : pool) c->stop();
+    FMF_LOG_INFO("[load] Shutting down after " << sent << " updates.");
+    return 0;
+}
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--delta [--keyframe-every N]] <client_id>\n"
+              << "       " << prog << " [--delta [--keyframe-every N]] --load N [--first-id ID] [--conns K] [--interval-ms MS]\n"
+              << "           [--mobility waypoint|manhattan]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int load = 0, first_id = 0, conns = 4, interval_ms = 5000;
+    bool delta = false;
+    int keyframe_every = 16;
+    MobilityMode mobility = MobilityMode::RANDOM_WAYPOINT;
+
+    static struct option long_options[] = {
+        {"load",        required_argument, 0, 'n'},
+        {"first-id",    required_argument, 0, 'f'},
+        {"conns",       required_argument, 0, 'c'},
+        {"interval-ms", required_argument, 0, 'i'},
+        {"delta",          no_argument,       0, 'd'},
+        {"keyframe-every", required_argument, 0, 'k'},
+        {"mobility",       required_argument, 0, 'm'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    int option_index = 0;
+    while ((opt = getopt_long(argc, argv, "n:f:c:i:dk:m:", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'n': load = std::atoi(optarg); break;
+            case 'f': first_id = std::atoi(optarg); break;
+            case 'c': conns = std::atoi(optarg); break;
+            case 'i': interval_ms = std::atoi(optarg); break;
+            case 'd': delta = true; break;
+            case 'k': keyframe_every = std::atoi(optarg); break;
+            case 'm':
+                if (std::string(optarg) == "manhattan") mobility = MobilityMode::MANHATTAN;
+                else if (std::string(optarg) != "waypoint") { usage(argv[0]); return 1; }
+                break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (load > 0) {
+        signal(SIGINT, signal_handler);
+        if (conns < 1) conns = 1;
+        if (interval_ms < 1) interval_ms = 1;
+        Wire wire(delta, load, keyframe_every);
+        return run_load(load, first_id, conns, interval_ms, mobility, wire);
+    }
+
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int id = std::stoi(argv[optind]);
+    FMF_LOG_INFO("[client" << id << "] Starting up...");
+
+    signal(SIGINT, signal_handler);
+
+    // Connects in the background; updates made while Redis is away wait
+    // in `pending` (only the latest one survives) and go out on reconnect
+    ReconnectingClient redis_client("client" + std::to_string(id));
+    redis_client.start();
+    CoalescingBuffer pending(1);
+    std::vector<std::pair<int, std::string>> scratch;
+    std::string last;   // for the log; scratch is moved out when sending
+
     float x = 10.0f + id, y = 20.0f + id;
+    // All of this client's updates go to the same shard, in order
+    const std::string channel = shard_channel(shard_of(id));
+    Wire wire(delta, 1, keyframe_every);
+    auto send = [&](cpp_redis::client& c, const std::string& msg, const cpp_redis::reply_callback_t& done) {
+        c.publish(channel, wire.payload(0, msg), done);
+    };
 
+    auto next_update = std::chrono::steady_clock::now();
     while (running) {
-        std::ostringstream msg;
-        msg << id << "," << x << "," << y;
-
-        try {
-            ///
-            /// Send the location update
-            ///
-            redis_client.publish("locations_raw", msg.str());
-            redis_client.commit();
-            std::cout << "[client" << id << "] Published: " << msg.str() << std::endl;
-            std::cout.flush();
-        } catch (const cpp_redis::redis_error &e) {
-            std::cerr << "[client" << id << "] Publish failed: " << e.what() << std::endl;
-            std::cerr.flush();
+        if (std::chrono::steady_clock::now() >= next_update) {
+            std::ostringstream msg;
+            msg << id << "," << x << "," << y << "," << now_us();
+            last = msg.str();
+            pending.put(id, last);
+
+            // simulate the person moving
+            x += 0.1f;
+            y += 0.1f;
+            // Wait a few seconds before sending another update
+            next_update += std::chrono::seconds(5);
+        }
+
+        ///
+        /// Send the location update (as soon as we are connected)
+        ///
+        if (drain_pending(redis_client, pending, scratch, DRAIN_BATCH, send)) {
+            FMF_LOG_INFO_SAMPLED("[client" << id << "] Published: " << last
+                                 << " (" << wire.bytes_per_update() << " bytes/update on the wire)");
         }
 
-        // simulate the person moving
-        x += 0.1f;
-        y += 0.1f;
-        // Wait a few seconds before sending another update
-        std::this_thread::sleep_for(std::chrono::seconds(5));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
 
-    redis_client.disconnect();
-    std::cout << "[client" << id << "] Shutting down." << std::endl;
-    std::cout.flush();
+    redis_client.stop();
+    FMF_LOG_INFO("[client" << id << "] Shutting down.");
     return 0;
 }
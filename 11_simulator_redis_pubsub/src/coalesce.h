@@ -0,0 +1,121 @@
+#ifndef FMF_COALESCE_H
+#define FMF_COALESCE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//
+// Last-value-wins buffer keyed by client id.
+//
+// Location updates are snapshots, so if a newer update for a client
+// arrives before the previous one was flushed, the older one is simply
+// overwritten. Between flushes the buffer therefore holds at most one
+// update per client; under overload stale positions are shed instead of
+// queued. Updates keep the order in which each client first appeared,
+// and a partial drain takes the oldest ones.
+//
+class CoalescingBuffer {
+public:
+    struct Stats {
+        uint64_t received = 0;
+        uint64_t coalesced = 0;   // overwritten before being flushed
+        uint64_t dropped = 0;     // rejected because max_clients was reached
+        uint64_t flushed = 0;
+    };
+
+    explicit CoalescingBuffer(size_t max_clients = 1 << 20) : max_clients_(max_clients) {}
+
+    // Returns false if the update was dropped
+    bool put(int client_id, std::string msg) {
+        std::lock_guard<std::mutex> lk(mtx_);
+        ++stats_.received;
+        auto it = index_.find(client_id);
+        if (it != index_.end()) {
+            pending_[it->second].second = std::move(msg);
+            ++stats_.coalesced;
+            return true;
+        }
+        if (pending_.size() - head_ >= max_clients_) {
+            ++stats_.dropped;
+            return false;
+        }
+        index_.emplace(client_id, pending_.size());
+        pending_.emplace_back(client_id, std::move(msg));
+        return true;
+    }
+
+    // Give back an update that was drained but could not be sent. If a
+    // newer update for the client arrived meanwhile, the old one is dropped.
+    void restore(int client_id, std::string msg) {
+        std::lock_guard<std::mutex> lk(mtx_);
+        --stats_.flushed;
+        if (index_.count(client_id)) {
+            ++stats_.coalesced;
+            return;
+        }
+        if (pending_.size() - head_ >= max_clients_) {
+            ++stats_.dropped;
+            return;
+        }
+        index_.emplace(client_id, pending_.size());
+        pending_.emplace_back(client_id, std::move(msg));
+    }
+
+    // Move everything pending into `out` (which is cleared first)
+    void drain(std::vector<std::pair<int, std::string>>& out) {
+        drain(out, SIZE_MAX);
+    }
+
+    // Move the `max` oldest pending updates into `out` (cleared first)
+    void drain(std::vector<std::pair<int, std::string>>& out, size_t max) {
+        out.clear();
+        std::lock_guard<std::mutex> lk(mtx_);
+        size_t n = std::min(max, pending_.size() - head_);
+        if (n == pending_.size()) {
+            out.swap(pending_);
+            index_.clear();
+        } else {
+            for (size_t i = head_; i < head_ + n; ++i) {
+                index_.erase(pending_[i].first);
+                out.push_back(std::move(pending_[i]));
+            }
+            head_ += n;
+            if (head_ == pending_.size()) {
+                pending_.clear();
+                head_ = 0;
+            } else if (head_ > pending_.size() / 2) {
+                // Slide the live part down so the vector does not grow forever
+                pending_.erase(pending_.begin(), pending_.begin() + head_);
+                for (auto& kv : index_) kv.second -= head_;
+                head_ = 0;
+            }
+        }
+        stats_.flushed += out.size();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lk(mtx_);
+        return pending_.size() - head_;
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lk(mtx_);
+        return stats_;
+    }
+
+private:
+    size_t max_clients_;
+    mutable std::mutex mtx_;
+    std::unordered_map<int, size_t> index_;          // client id -> slot in pending_
+    std::vector<std::pair<int, std::string>> pending_;
+    size_t head_ = 0;                                // pending_[0, head_) already drained
+    Stats stats_;
+};
+
+#endif // FMF_COALESCE_H
@@ -0,0 +1,145 @@
+#ifndef FMF_CREDITS_H
+#define FMF_CREDITS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+//
+// Credit-based flow control (opt-in, --credits on every stage).
+//
+// A downstream stage grants credits to its upstream, one per message it
+// has finished with; the upstream sends only while it holds credits and
+// otherwise keeps updates in a last-value-wins buffer. A slow stage so
+// slows the one before it and stale positions are shed at the source,
+// instead of Redis buffering output until it drops the connection.
+//
+//   server_forward -> server_ingest   on credits.forward
+//   receiver       -> server_forward  on credits.receiver.<user> (or .all)
+//
+// A grant is the text "credits,window". The upstream never holds more
+// than `window` credits, so repeated grants cannot pile up a burst.
+// Grants over pub/sub can be lost and an upstream can restart with none,
+// so a granter that has seen no traffic for CREDIT_REFRESH_MS grants a
+// full window again.
+//
+// Stages also publish their queue depths on fmf.stats every few seconds
+// (`redis-cli subscribe fmf.stats`).
+//
+
+static const char* const CREDITS_FORWARD = "credits.forward";
+static const char* const CREDITS_RECEIVER_PATTERN = "credits.receiver.*";
+static const char* const STATS_CHANNEL = "fmf.stats";
+static const int64_t CREDIT_WINDOW = 4096;
+static const int CREDIT_REFRESH_MS = 1000;
+// How often granters announce what was consumed
+static const int CREDIT_GRANT_MS = 10;
+
+// Grants for the receiver of `user`; -1 is the broadcast receiver
+inline std::string receiver_credit_channel(int user) {
+    return user < 0 ? "credits.receiver.all" : "credits.receiver." + std::to_string(user);
+}
+
+// "credits,window" -> false if malformed
+inline bool parse_grant(const std::string& msg, int64_t& credits, int64_t& window) {
+    char* end;
+    credits = std::strtoll(msg.c_str(), &end, 10);
+    if (*end != ',') return false;
+    window = std::strtoll(end + 1, nullptr, 10);
+    return credits >= 0 && window > 0;
+}
+
+inline std::string grant_message(int64_t credits, int64_t window) {
+    return std::to_string(credits) + "," + std::to_string(window);
+}
+
+//
+// Upstream side: credits available for one downstream. Thread-safe.
+//
+class CreditGate {
+public:
+    void grant(int64_t n, int64_t window) {
+        window_.store(window, std::memory_order_relaxed);
+        int64_t cur = credits_.load(std::memory_order_relaxed);
+        while (!credits_.compare_exchange_weak(cur, std::min(window, cur + n), std::memory_order_release)) {}
+    }
+
+    // Take up to `want` credits; returns how many were taken
+    int64_t take(int64_t want) {
+        int64_t cur = credits_.load(std::memory_order_acquire);
+        int64_t got;
+        do {
+            got = std::min(cur, want);
+            if (got <= 0) {
+                if (want > 0) starved_.fetch_add(1, std::memory_order_relaxed);
+                return 0;
+            }
+        } while (!credits_.compare_exchange_weak(cur, cur - got, std::memory_order_acquire));
+        if (got < want) starved_.fetch_add(1, std::memory_order_relaxed);
+        return got;
+    }
+
+    // Hand back credits that were taken but not used
+    void refund(int64_t n) {
+        if (n > 0) grant(n, window_.load(std::memory_order_relaxed));
+    }
+
+    int64_t available() const { return credits_.load(std::memory_order_relaxed); }
+    uint64_t starved() const { return starved_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> credits_{0};
+    std::atomic<int64_t> window_{CREDIT_WINDOW};
+    std::atomic<uint64_t> starved_{0};
+};
+
+//
+// Downstream side: counts consumed messages (any thread) and tells one
+// thread how many credits to announce.
+//
+class CreditGranter {
+public:
+    explicit CreditGranter(int64_t window = CREDIT_WINDOW) : window_(window) {}
+
+    void consumed(int64_t n = 1) { consumed_.fetch_add(n, std::memory_order_relaxed); }
+
+    // Credits to grant now (0 = nothing to send). `accepting` is false
+    // while our own queue is too deep to take more work.
+    int64_t due(bool accepting) {
+        auto now = std::chrono::steady_clock::now();
+        int64_t c = consumed_.load(std::memory_order_relaxed);
+        if (!started_) {
+            started_ = true;
+            granted_for_ = c;
+            last_activity_ = now;
+            return window_;
+        }
+        if (!accepting) return 0;
+        int64_t fresh = c - granted_for_;
+        granted_for_ = c;
+        if (fresh > 0) {
+            last_activity_ = now;
+            return fresh;
+        }
+        if (now - last_activity_ >= std::chrono::milliseconds(CREDIT_REFRESH_MS)) {
+            last_activity_ = now;
+            return window_;
+        }
+        return 0;
+    }
+
+    int64_t window() const { return window_; }
+    int64_t consumed_total() const { return consumed_.load(std::memory_order_relaxed); }
+
+private:
+    int64_t window_;
+    std::atomic<int64_t> consumed_{0};
+    int64_t granted_for_ = 0;
+    bool started_ = false;
+    std::chrono::steady_clock::time_point last_activity_;
+};
+
+#endif // FMF_CREDITS_H
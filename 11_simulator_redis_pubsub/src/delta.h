@@ -0,0 +1,212 @@
+#ifndef FMF_DELTA_H
+#define FMF_DELTA_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+//
+// Quantized delta encoding of location updates (optional, client --delta).
+//
+// A client's updates form a sequence of binary frames:
+//
+//   keyframe: 0x01 | varint id | varint seq | f64 lat | f64 lon | varint t_send
+//   delta:    0x02 | varint id | varint seq | i16 dlat | i16 dlon | zigzag varint dt
+//
+// Deltas are in units of DELTA_QUANTUM and relative to the position the
+// decoder reconstructed from the previous frame, so rounding error never
+// accumulates. A keyframe is sent every `keyframe_every` frames, or
+// whenever a delta would not fit in 16 bits. A decoder that sees a gap in
+// seq drops deltas until the next keyframe.
+//
+// Positions are degrees. One quantum (1e-5 deg) is about 1.1 m of
+// latitude and 0.9 m of longitude at the load generator's latitude, so a
+// decoded position is within about half a metre of the true one. A
+// walker covers a few metres between updates, well clear of rounding to
+// zero, and an int16 delta still spans +-0.33 deg before a keyframe is
+// forced.
+//
+// Text updates always start with a digit or '-', so the first byte tells
+// the two formats apart.
+//
+
+static const double DELTA_QUANTUM = 1e-5;   // degrees
+static const uint8_t FRAME_KEY = 0x01;
+static const uint8_t FRAME_DELTA = 0x02;
+
+inline bool is_delta_frame(const std::string& msg) {
+    return !msg.empty() && (msg[0] == FRAME_KEY || msg[0] == FRAME_DELTA);
+}
+
+namespace delta_detail {
+
+inline void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+inline bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+inline uint64_t zigzag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+template <typename T>
+inline void put_raw(std::string& out, T v) {
+    char b[sizeof(T)];
+    std::memcpy(b, &v, sizeof(T));   // little-endian hosts only (x86, arm64)
+    out.append(b, sizeof(T));
+}
+
+template <typename T>
+inline bool get_raw(const uint8_t*& p, const uint8_t* end, T& v) {
+    if (end - p < static_cast<long>(sizeof(T))) return false;
+    std::memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+
+} // namespace delta_detail
+
+//
+// Per-client encoder state (client side)
+//
+class DeltaEncoder {
+public:
+    explicit DeltaEncoder(int keyframe_every = 16) : keyframe_every_(keyframe_every) {}
+
+    // Append the frame for this update to `out`
+    void encode(int id, double lat, double lon, int64_t t_send, std::string& out) {
+        using namespace delta_detail;
+        long dlat = std::lround((lat - lat_) / DELTA_QUANTUM);
+        long dlon = std::lround((lon - lon_) / DELTA_QUANTUM);
+        bool key = !started_ || since_key_ >= keyframe_every_ ||
+                   dlat < INT16_MIN || dlat > INT16_MAX || dlon < INT16_MIN || dlon > INT16_MAX;
+
+        out += static_cast<char>(key ? FRAME_KEY : FRAME_DELTA);
+        put_varint(out, static_cast<uint32_t>(id));
+        put_varint(out, seq_++);
+        if (key) {
+            put_raw<double>(out, lat);
+            put_raw<double>(out, lon);
+            put_varint(out, static_cast<uint64_t>(t_send));
+            lat_ = lat;
+            lon_ = lon;
+            since_key_ = 1;
+            started_ = true;
+        } else {
+            put_raw<int16_t>(out, static_cast<int16_t>(dlat));
+            put_raw<int16_t>(out, static_cast<int16_t>(dlon));
+            put_varint(out, zigzag(t_send - t_));
+            // Track what the decoder will reconstruct, not the true position
+            lat_ += dlat * DELTA_QUANTUM;
+            lon_ += dlon * DELTA_QUANTUM;
+            ++since_key_;
+        }
+        t_ = t_send;
+    }
+
+private:
+    int keyframe_every_;
+    bool started_ = false;
+    int since_key_ = 0;
+    uint64_t seq_ = 0;
+    double lat_ = 0, lon_ = 0;
+    int64_t t_ = 0;
+};
+
+//
+// Decoder for all clients (server side). Not thread-safe: use one per
+// subscriber thread. A client's frames must arrive in order, which the
+// shard channels guarantee.
+//
+class DeltaDecoder {
+public:
+    enum Result { OK, GAP, BAD };
+
+    struct Stats {
+        uint64_t keyframes = 0;
+        uint64_t deltas = 0;
+        uint64_t gaps = 0;       // seq jumps detected
+        uint64_t dropped = 0;    // deltas discarded while waiting for a keyframe
+        uint64_t bad = 0;        // malformed frames
+        uint64_t bytes = 0;      // frame bytes seen
+    };
+
+    Result decode(const std::string& frame, int& id, double& lat, double& lon, int64_t& t_send) {
+        using namespace delta_detail;
+        stats_.bytes += frame.size();
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(frame.data());
+        const uint8_t* end = p + frame.size();
+        uint64_t id64, seq;
+        if (p == end) return bad();
+        uint8_t tag = *p++;
+        if (!get_varint(p, end, id64) || !get_varint(p, end, seq)) return bad();
+        id = static_cast<int>(id64);
+        State& st = clients_[id];
+
+        if (tag == FRAME_KEY) {
+            uint64_t t;
+            if (!get_raw(p, end, st.lat) || !get_raw(p, end, st.lon) || !get_varint(p, end, t)) return bad();
+            st.t = static_cast<int64_t>(t);
+            st.synced = true;
+            ++stats_.keyframes;
+        } else if (tag == FRAME_DELTA) {
+            if (st.synced && seq != st.seq + 1) {
+                st.synced = false;
+                ++stats_.gaps;
+            }
+            if (!st.synced) {
+                ++stats_.dropped;
+                return GAP;
+            }
+            int16_t dlat, dlon;
+            uint64_t dt;
+            if (!get_raw(p, end, dlat) || !get_raw(p, end, dlon) || !get_varint(p, end, dt)) return bad();
+            st.lat += dlat * DELTA_QUANTUM;
+            st.lon += dlon * DELTA_QUANTUM;
+            st.t += unzigzag(dt);
+            ++stats_.deltas;
+        } else {
+            return bad();
+        }
+
+        st.seq = seq;
+        lat = st.lat;
+        lon = st.lon;
+        t_send = st.t;
+        return OK;
+    }
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct State {
+        bool synced = false;
+        uint64_t seq = 0;
+        double lat = 0, lon = 0;
+        int64_t t = 0;
+    };
+
+    Result bad() {
+        ++stats_.bad;
+        return BAD;
+    }
+
+    std::unordered_map<int, State> clients_;
+    Stats stats_;
+};
+
+#endif // FMF_DELTA_H
@@ -0,0 +1,76 @@
+#ifndef FMF_FRIENDS_H
+#define FMF_FRIENDS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Channel a user listens on for their friends' positions
+inline std::string user_channel(int user_id) {
+    return "locations_out." + std::to_string(user_id);
+}
+
+//
+// Friend lists in compressed sparse row (CSR) form.
+// The friends of user u are targets[offsets[u] .. offsets[u+1]).
+//
+struct FriendGraph {
+    std::vector<uint32_t> offsets{0};
+    std::vector<int> targets;
+
+    int num_users() const { return static_cast<int>(offsets.size()) - 1; }
+    bool has_user(int u) const { return u >= 0 && u < num_users(); }
+
+    const int* friends_begin(int u) const { return targets.data() + offsets[u]; }
+    const int* friends_end(int u) const { return targets.data() + offsets[u + 1]; }
+    uint32_t degree(int u) const { return offsets[u + 1] - offsets[u]; }
+
+    // Load "user,friend" lines (header line optional). Friendship is
+    // mutual, so every line adds both directions. Duplicates are dropped.
+    bool load(const std::string& path) {
+        FILE* f = std::fopen(path.c_str(), "r");
+        if (!f) return false;
+
+        std::vector<std::pair<int, int>> pairs;
+        int max_id = -1;
+        char line[256];
+        while (std::fgets(line, sizeof(line), f)) {
+            int a, b;
+            if (std::sscanf(line, "%d,%d", &a, &b) != 2) continue; // header / junk
+            if (a < 0 || b < 0 || a == b) continue;
+            pairs.emplace_back(a, b);
+            max_id = std::max(max_id, std::max(a, b));
+        }
+        std::fclose(f);
+
+        // Counting sort into CSR, both directions
+        std::vector<uint32_t> off(max_id + 2, 0);
+        for (auto& p : pairs) { ++off[p.first + 1]; ++off[p.second + 1]; }
+        for (size_t i = 1; i < off.size(); ++i) off[i] += off[i - 1];
+
+        std::vector<int> tgt(off.back());
+        std::vector<uint32_t> fill(off.begin(), off.end() - 1);
+        for (auto& p : pairs) {
+            tgt[fill[p.first]++] = p.second;
+            tgt[fill[p.second]++] = p.first;
+        }
+
+        // Sort and dedupe each row, compacting in place
+        offsets.assign(1, 0);
+        targets.clear();
+        targets.reserve(tgt.size());
+        for (int u = 0; u <= max_id; ++u) {
+            auto b = tgt.begin() + off[u], e = tgt.begin() + off[u + 1];
+            std::sort(b, e);
+            auto last = std::unique(b, e);
+            targets.insert(targets.end(), b, last);
+            offsets.push_back(static_cast<uint32_t>(targets.size()));
+        }
+        return true;
+    }
+};
+
+#endif // FMF_FRIENDS_H
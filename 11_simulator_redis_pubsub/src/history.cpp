@@ -0,0 +1,217 @@
+////
+//// Location history: records every update leaving ingest so trajectories
+//// can be queried later
+////
+
+#include <cpp_redis/cpp_redis>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <csignal>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <getopt.h>
+#include <unistd.h>
+#include "history.h"
+#include "log.h"
+#include "streams.h"
+#include "trace.h"
+
+std::atomic<bool> running{true};
+
+void signal_handler(int) {
+    running = false;
+}
+
+// "id,lat,lon[,t_send[,...]]" -> record fields; t defaults to now
+static bool parse_update(const std::string& msg, int& id, int64_t& t, double& lat, double& lon) {
+    long long t_send = 0;
+    int n = std::sscanf(msg.c_str(), "%d,%lf,%lf,%lld", &id, &lat, &lon, &t_send);
+    if (n < 3) return false;
+    t = n == 4 ? t_send : now_us();
+    return true;
+}
+
+//
+// Subscribe to what ingest emits and append it to the store. With
+// streams, history is its own consumer group, so it sees every entry
+// independently of the forwarders.
+//
+static int record(HistoryStore& store, bool streams) {
+    std::mutex mtx;
+    uint64_t appended = 0;
+    auto on_update = [&](const std::string& msg) {
+        int id;
+        int64_t t;
+        double lat, lon;
+        if (!parse_update(msg, id, t, lat, lon)) return;
+        std::lock_guard<std::mutex> lk(mtx);
+        store.append(id, t, lat, lon);
+        ++appended;
+    };
+
+    cpp_redis::subscriber sub;
+    cpp_redis::client reader;
+    std::thread stream_reader;
+    if (!streams) {
+        sub.connect("127.0.0.1", 6379);
+        sub.subscribe("locations_mid", [&](const std::string&, const std::string& msg) { on_update(msg); });
+        sub.commit();
+    } else {
+        reader.connect("127.0.0.1", 6379);
+        ensure_group(reader, STREAM_MID, "history");
+        // Replay what this consumer was given but never acked (we crashed
+        // before recording it), then switch to new entries
+        stream_reader = std::thread([&]() {
+            const std::string consumer = stable_consumer("history");
+            std::vector<StreamEntry> entries;
+            std::vector<std::string> ids;
+            std::string from_id = "0";
+            while (running) {
+                try {
+                    read_group(reader, STREAM_MID, "history", consumer, from_id, 512, 100, entries);
+                    advance_cursor(from_id, entries);
+                    ids.clear();
+                    for (auto& e : entries) {
+                        if (!e.trimmed) on_update(e.msg);
+                        ids.push_back(std::move(e.id));
+                    }
+                    if (!ids.empty()) {
+                        reader.send(xack_cmd(STREAM_MID, "history", ids), nullptr);
+                        reader.commit();
+                    }
+                } catch (const cpp_redis::redis_error &e) {
+                    FMF_LOG_ERROR("[history] XREADGROUP failed: " << e.what());
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
+                    // Redis came back without the stream: recreate our group
+                    if (std::string(e.what()).find("NOGROUP") != std::string::npos) {
+                        try {
+                            ensure_group(reader, STREAM_MID, "history");
+                        } catch (const cpp_redis::redis_error &) {
+                        }
+                    }
+                }
+            }
+        });
+    }
+    FMF_LOG_INFO("[history] Recording " << (streams ? STREAM_MID : "locations_mid") << ", "
+                 << store.size() << " records already stored");
+
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        std::lock_guard<std::mutex> lk(mtx);
+        FMF_LOG_INFO_SAMPLED("[history] " << appended << " appended, " << store.size() << " records, "
+                             << store.client_count() << " clients, " << store.segment_count() << " segments");
+    }
+
+    if (streams) {
+        stream_reader.join();
+        reader.disconnect();
+    } else {
+        sub.unsubscribe("locations_mid");
+        sub.disconnect();
+    }
+    store.sync();
+    FMF_LOG_INFO("[history] Shutting down after " << appended << " records.");
+    return 0;
+}
+
+// Write `n` synthetic records to a scratch store and time appends and queries
+static int bench(uint64_t n, uint64_t capacity) {
+    std::string dir = "/tmp/fmf_history_bench." + std::to_string(getpid());
+    const int clients = 100000;
+    {
+        HistoryStore store(dir, capacity);
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < n; ++i) {
+            int id = static_cast<int>(i % clients);
+            store.append(id, static_cast<int64_t>(i / clients) * 5000000, 10.0 + i * 1e-6, 20.0 + i * 1e-6);
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "append: " << n << " records in " << secs << " s = "
+                  << static_cast<uint64_t>(n / secs) << " records/s, " << store.segment_count() << " segments" << std::endl;
+
+        const int queries = 100000;
+        uint64_t hits = 0;
+        int64_t span = static_cast<int64_t>(n / clients) * 5000000;
+        start = std::chrono::steady_clock::now();
+        for (int q = 0; q < queries; ++q) {
+            int64_t t0 = (static_cast<int64_t>(q) * 7919 % (span + 1));
+            hits += store.query(q % clients, t0, t0 + 60 * 1000000LL).size();
+        }
+        secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "query: " << queries << " one-minute range queries in " << secs << " s = "
+                  << static_cast<uint64_t>(queries / secs) << " queries/s (" << hits << " records)" << std::endl;
+    }
+    std::string cmd = "rm -rf '" + dir + "'";
+    return std::system(cmd.c_str()) == 0 ? 0 : 1;
+}
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--dir D] [--capacity N] record [--transport pubsub|streams]\n"
+              << "       " << prog << " [--dir D] [--capacity N] query CLIENT T0_US T1_US\n"
+              << "       " << prog << " [--dir D] [--capacity N] compact T_MIN_US\n"
+              << "       " << prog << " [--capacity N] bench [RECORDS]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string dir = "history";
+    uint64_t capacity = HistoryStore::DEFAULT_CAPACITY;
+    bool streams = false;
+
+    static struct option long_options[] = {
+        {"dir",       required_argument, 0, 'd'},
+        {"capacity",  required_argument, 0, 'c'},
+        {"transport", required_argument, 0, 'T'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    int option_index = 0;
+    while ((opt = getopt_long(argc, argv, "d:c:T:", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'd': dir = optarg; break;
+            case 'c': capacity = std::strtoull(optarg, nullptr, 10); break;
+            case 'T': streams = std::string(optarg) == "streams"; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc || capacity == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string cmd = argv[optind];
+    char** args = argv + optind + 1;
+    int nargs = argc - optind - 1;
+
+    try {
+        if (cmd == "bench") {
+            return bench(nargs >= 1 ? std::strtoull(args[0], nullptr, 10) : 10000000, capacity);
+        }
+
+        HistoryStore store(dir, capacity);
+        if (cmd == "record") {
+            signal(SIGINT, signal_handler);
+            return record(store, streams);
+        }
+        if (cmd == "query" && nargs == 3) {
+            std::cout << "client_id,t_us,lat,lon\n";
+            for (auto& r : store.query(std::atoi(args[0]), std::atoll(args[1]), std::atoll(args[2])))
+                std::cout << r.client_id << "," << r.t_us << "," << r.lat << "," << r.lon << "\n";
+            return 0;
+        }
+        if (cmd == "compact" && nargs == 1) {
+            uint64_t before = store.size();
+            store.compact(std::atoll(args[0]));
+            store.sync();
+            std::cout << "compacted " << before << " -> " << store.size() << " records" << std::endl;
+            return 0;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "[history] " << e.what() << std::endl;
+        return 1;
+    }
+    usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,333 @@
+#ifndef FMF_HISTORY_H
+#define FMF_HISTORY_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+// Append-only location history on memory-mapped segment files.
+//
+// Every position is a fixed 32-byte record appended to the current
+// segment (dir/seg_NNNNNN.fmf). A segment is a small header plus
+// `capacity` record slots, created at full size and mapped once, so an
+// append is a bounds check and a 32-byte store. When a segment fills up
+// a new one is started (rollover); full segments stay mapped read-only
+// for queries.
+//
+// An in-memory index keeps, per client, the global record numbers of its
+// records in append order. Records arrive per client in time order, so
+// a range query (client, t0, t1) is two binary searches in that list.
+// The index is rebuilt by scanning the segments on open.
+//
+// compact(t_min) rewrites the store without records older than t_min.
+// Survivors are copied segment by segment into compact_NNNNNN.fmf files,
+// which are synced before a commit marker is written; only then do they
+// replace the old segments. A crash before the marker leaves the old
+// store intact, and one after it is finished on the next open.
+//
+
+struct HistoryRecord {
+    int64_t t_us;
+    double lat;
+    double lon;
+    int32_t client_id;
+    uint32_t reserved;
+};
+static_assert(sizeof(HistoryRecord) == 32, "HistoryRecord must stay 32 bytes");
+
+class HistoryStore {
+public:
+    static const uint64_t DEFAULT_CAPACITY = 1 << 20;   // records per segment (32 MB)
+
+    explicit HistoryStore(std::string dir, uint64_t capacity = DEFAULT_CAPACITY)
+        : dir_(std::move(dir)), capacity_(capacity) {
+        ::mkdir(dir_.c_str(), 0755);
+        recover_compaction();
+        open_existing();
+        if (segments_.empty() || segments_.back().header->count == capacity_) add_segment();
+    }
+
+    ~HistoryStore() { close_all(); }
+
+    HistoryStore(const HistoryStore&) = delete;
+    HistoryStore& operator=(const HistoryStore&) = delete;
+
+    void append(int client_id, int64_t t_us, double lat, double lon) {
+        Segment* seg = &segments_.back();
+        if (seg->header->count == capacity_) seg = &add_segment();
+        uint64_t slot = seg->header->count;
+        HistoryRecord& r = seg->records[slot];
+        r.t_us = t_us;
+        r.lat = lat;
+        r.lon = lon;
+        r.client_id = client_id;
+        r.reserved = 0;
+        // Publish the record before the count so a crash never exposes a
+        // half-written slot
+        __atomic_store_n(&seg->header->count, slot + 1, __ATOMIC_RELEASE);
+        index_[client_id].push_back((segments_.size() - 1) * capacity_ + slot);
+        ++total_;
+    }
+
+    // Records of `client_id` with t0 <= t_us <= t1, in time order
+    std::vector<HistoryRecord> query(int client_id, int64_t t0, int64_t t1) const {
+        std::vector<HistoryRecord> out;
+        auto it = index_.find(client_id);
+        if (it == index_.end()) return out;
+        const std::vector<uint64_t>& refs = it->second;
+        auto lo = std::lower_bound(refs.begin(), refs.end(), t0,
+            [this](uint64_t ref, int64_t t) { return record(ref).t_us < t; });
+        auto hi = std::upper_bound(lo, refs.end(), t1,
+            [this](int64_t t, uint64_t ref) { return t < record(ref).t_us; });
+        out.reserve(hi - lo);
+        for (auto r = lo; r != hi; ++r) out.push_back(record(*r));
+        return out;
+    }
+
+    // Flush dirty pages of all segments to disk
+    void sync() {
+        for (auto& s : segments_) ::msync(s.base, s.bytes, MS_SYNC);
+    }
+
+    // Drop every record older than t_min. If this throws, the store is
+    // unchanged.
+    void compact(int64_t t_min) {
+        uint64_t written = 0;
+        Segment out{};
+        bool open_out = false;
+        try {
+            for (auto& s : segments_) {
+                for (uint64_t i = 0; i < s.header->count; ++i) {
+                    const HistoryRecord& r = s.records[i];
+                    if (r.t_us < t_min) continue;
+                    if (open_out && out.header->count == capacity_) {
+                        open_out = false;
+                        seal(out);
+                    }
+                    if (!open_out) {
+                        out = map_segment(compact_path(written++), true);
+                        open_out = true;
+                    }
+                    out.records[out.header->count++] = r;
+                }
+            }
+            if (open_out) {
+                open_out = false;
+                seal(out);
+            }
+            sync_path(dir_);
+            write_commit(written);
+        } catch (...) {
+            if (open_out) ::munmap(out.base, out.bytes);
+            for (uint64_t n = 0; n < written; ++n) ::unlink(compact_path(n).c_str());
+            throw;
+        }
+
+        close_all();
+        finish_compaction(written);
+        index_.clear();
+        total_ = 0;
+        next_number_ = 0;
+        open_existing();
+        if (segments_.empty() || segments_.back().header->count == capacity_) add_segment();
+    }
+
+    uint64_t size() const { return total_; }
+    size_t segment_count() const { return segments_.size(); }
+    size_t client_count() const { return index_.size(); }
+
+private:
+    static const uint64_t MAGIC = 0x31534948464d46ULL;   // "FMFHIS1"
+
+    struct Header {
+        uint64_t magic;
+        uint64_t capacity;
+        uint64_t count;
+        uint64_t pad[5];   // keep records 64-byte aligned
+    };
+
+    struct Segment {
+        std::string path;
+        void* base;
+        size_t bytes;
+        Header* header;
+        HistoryRecord* records;
+    };
+
+    const HistoryRecord& record(uint64_t ref) const {
+        return segments_[ref / capacity_].records[ref % capacity_];
+    }
+
+    std::string segment_path(uint64_t n) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/seg_%06llu.fmf", static_cast<unsigned long long>(n));
+        return dir_ + name;
+    }
+
+    std::string compact_path(uint64_t n) const {
+        char name[40];
+        std::snprintf(name, sizeof(name), "/compact_%06llu.fmf", static_cast<unsigned long long>(n));
+        return dir_ + name;
+    }
+
+    std::string commit_path() const { return dir_ + "/compact.commit"; }
+
+    static void sync_path(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("open " + path + ": " + std::strerror(errno));
+        int rc = ::fsync(fd);
+        ::close(fd);
+        if (rc != 0) throw std::runtime_error("fsync " + path + ": " + std::strerror(errno));
+    }
+
+    // Flush a freshly written segment to disk and unmap it
+    static void seal(Segment& s) {
+        int rc = ::msync(s.base, s.bytes, MS_SYNC);
+        int err = errno;
+        ::munmap(s.base, s.bytes);
+        if (rc != 0) throw std::runtime_error("msync " + s.path + ": " + std::strerror(err));
+        sync_path(s.path);
+    }
+
+    // The commit point of compact(): a marker naming how many compacted
+    // segments there are, made visible with an atomic rename
+    void write_commit(uint64_t segments) {
+        std::string tmp = commit_path() + ".tmp";
+        std::FILE* f = std::fopen(tmp.c_str(), "w");
+        if (!f) throw std::runtime_error("open " + tmp + ": " + std::strerror(errno));
+        bool ok = std::fprintf(f, "%llu\n", static_cast<unsigned long long>(segments)) > 0;
+        ok = std::fflush(f) == 0 && ok;
+        ok = ::fsync(::fileno(f)) == 0 && ok;
+        ok = std::fclose(f) == 0 && ok;
+        if (!ok || ::rename(tmp.c_str(), commit_path().c_str()) != 0) {
+            int err = errno;
+            ::unlink(tmp.c_str());
+            throw std::runtime_error("write " + commit_path() + ": " + std::strerror(err));
+        }
+        sync_path(dir_);
+    }
+
+    // Replace the segments with the `segments` compacted ones. Every step
+    // can be repeated, so a crash in here is finished on the next open.
+    void finish_compaction(uint64_t segments) {
+        for (auto& n : list_dir("seg_")) {
+            if (std::strtoull(n.c_str() + 4, nullptr, 10) >= segments) ::unlink((dir_ + "/" + n).c_str());
+        }
+        for (uint64_t n = 0; n < segments; ++n) {
+            std::string from = compact_path(n);
+            if (::access(from.c_str(), F_OK) == 0 && ::rename(from.c_str(), segment_path(n).c_str()) != 0)
+                throw std::runtime_error("rename " + from + ": " + std::strerror(errno));
+        }
+        sync_path(dir_);
+        ::unlink(commit_path().c_str());
+        sync_path(dir_);
+    }
+
+    // Finish a committed compaction, or throw away the output of one that
+    // never reached its commit marker
+    void recover_compaction() {
+        if (std::FILE* f = std::fopen(commit_path().c_str(), "r")) {
+            unsigned long long segments = 0;
+            bool ok = std::fscanf(f, "%llu", &segments) == 1;
+            std::fclose(f);
+            if (!ok) throw std::runtime_error(commit_path() + ": unreadable compaction marker");
+            finish_compaction(segments);
+        } else {
+            for (auto& n : list_dir("compact_")) ::unlink((dir_ + "/" + n).c_str());
+            ::unlink((commit_path() + ".tmp").c_str());
+        }
+    }
+
+    // Names of the *.fmf files in the store starting with `prefix`, sorted
+    std::vector<std::string> list_dir(const std::string& prefix) const {
+        std::vector<std::string> names;
+        if (DIR* d = ::opendir(dir_.c_str())) {
+            while (dirent* e = ::readdir(d)) {
+                std::string n = e->d_name;
+                if (n.rfind(prefix, 0) == 0 && n.size() > prefix.size() + 4 &&
+                    n.compare(n.size() - 4, 4, ".fmf") == 0)
+                    names.push_back(n);
+            }
+            ::closedir(d);
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    Segment map_segment(const std::string& path, bool create) {
+        size_t bytes = sizeof(Header) + capacity_ * sizeof(HistoryRecord);
+        int fd = ::open(path.c_str(), create ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR, 0644);
+        if (fd < 0) throw std::runtime_error("open " + path + ": " + std::strerror(errno));
+        if (create) {
+            // Allocate the blocks now: running out of space is an error
+            // here rather than a SIGBUS on some later store
+            int rc = ::posix_fallocate(fd, 0, bytes);
+            if (rc != 0) {
+                ::close(fd);
+                ::unlink(path.c_str());
+                throw std::runtime_error("fallocate " + path + ": " + std::strerror(rc));
+            }
+        }
+        void* base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) throw std::runtime_error("mmap " + path + ": " + std::strerror(errno));
+
+        Segment s{path, base, bytes, static_cast<Header*>(base),
+                  reinterpret_cast<HistoryRecord*>(static_cast<char*>(base) + sizeof(Header))};
+        if (create) {
+            s.header->magic = MAGIC;
+            s.header->capacity = capacity_;
+            s.header->count = 0;
+        } else if (s.header->magic != MAGIC || s.header->capacity != capacity_) {
+            ::munmap(base, bytes);
+            throw std::runtime_error(path + ": not a history segment with capacity " + std::to_string(capacity_));
+        }
+        return s;
+    }
+
+    Segment& add_segment() {
+        // The previous segment is full: nothing writes to it any more
+        if (!segments_.empty()) ::mprotect(segments_.back().base, segments_.back().bytes, PROT_READ);
+        segments_.push_back(map_segment(segment_path(next_number_++), true));
+        return segments_.back();
+    }
+
+    void open_existing() {
+        for (auto& n : list_dir("seg_")) {
+            segments_.push_back(map_segment(dir_ + "/" + n, false));
+            next_number_ = std::strtoull(n.c_str() + 4, nullptr, 10) + 1;
+            Segment& s = segments_.back();
+            uint64_t base_ref = (segments_.size() - 1) * capacity_;
+            for (uint64_t i = 0; i < s.header->count; ++i)
+                index_[s.records[i].client_id].push_back(base_ref + i);
+            total_ += s.header->count;
+        }
+    }
+
+    void close_all() {
+        for (auto& s : segments_) ::munmap(s.base, s.bytes);
+        segments_.clear();
+    }
+
+    std::string dir_;
+    uint64_t capacity_;
+    uint64_t next_number_ = 0;
+    uint64_t total_ = 0;
+    std::vector<Segment> segments_;
+    std::unordered_map<int, std::vector<uint64_t>> index_;
+};
+
+#endif // FMF_HISTORY_H
@@ -0,0 +1,147 @@
+#ifndef FMF_LOG_H
+#define FMF_LOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <utility>
+
+//
+// Logging for the simulator binaries.
+//
+// Levels below FMF_LOG_LEVEL compile to nothing: the arguments are
+// never evaluated. Build with -DFMF_LOG_LEVEL=0 for per-message debug
+// traces, the default (1) keeps info and up.
+//
+// FMF_LOG_INFO_SAMPLED logs only 1 in N calls per call site, where N
+// comes from the FMF_LOG_SAMPLE environment variable (default 1 = all).
+// Use it for per-message info lines on the hot path.
+//
+// Each line is formatted into a thread-local buffer that is reused, so
+// logging allocates nothing in the steady state, and written with a
+// single fwrite, without flushing: stdout is line-buffered on a terminal
+// and block-buffered when redirected (use stdbuf -oL to watch a log).
+//
+
+#define FMF_LEVEL_DEBUG 0
+#define FMF_LEVEL_INFO  1
+#define FMF_LEVEL_WARN  2
+#define FMF_LEVEL_ERROR 3
+#define FMF_LEVEL_NONE  4
+
+#ifndef FMF_LOG_LEVEL
+#define FMF_LOG_LEVEL FMF_LEVEL_INFO
+#endif
+
+namespace fmf_log {
+
+inline uint64_t sample_every() {
+    static const uint64_t n = [] {
+        const char* env = std::getenv("FMF_LOG_SAMPLE");
+        long v = env ? std::atol(env) : 1;
+        return static_cast<uint64_t>(v > 0 ? v : 1);
+    }();
+    return n;
+}
+
+// A streambuf over a fixed array. std::stringbuf would cost two
+// allocations per line (str("") to reset, and str() returns a copy);
+// here a line longer than the array spills into a string that keeps its
+// capacity from line to line.
+class LineBuffer : public std::streambuf {
+public:
+    LineBuffer() { reset(); }
+
+    void reset() {
+        spill_.clear();
+        setp(buf_, buf_ + sizeof(buf_));
+    }
+
+    void write(FILE* f) {
+        if (spill_.empty()) {
+            std::fwrite(pbase(), 1, pptr() - pbase(), f);
+            return;
+        }
+        spill_.append(pbase(), pptr());
+        std::fwrite(spill_.data(), 1, spill_.size(), f);
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        spill_.append(pbase(), pptr());
+        setp(buf_, buf_ + sizeof(buf_));
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+private:
+    char buf_[512];
+    std::string spill_;
+};
+
+struct LineStream {
+    LineBuffer buf;
+    std::ostream os{&buf};
+};
+
+inline std::ostream& line_buffer() {
+    thread_local LineStream line;
+    line.buf.reset();
+    line.os.clear();
+    return line.os;
+}
+
+inline void write_line(FILE* f, std::ostream& os) {
+    os << '\n';
+    static_cast<LineBuffer*>(os.rdbuf())->write(f);
+}
+
+} // namespace fmf_log
+
+#define FMF_LOG_WRITE(file, expr) \
+    do { std::ostream& fmf_os_ = fmf_log::line_buffer(); fmf_os_ << expr; fmf_log::write_line(file, fmf_os_); } while (0)
+
+// Disabled levels: the expression only appears in an unevaluated sizeof,
+// so it is type-checked (and its variables count as used) but no code is
+// generated
+#define FMF_LOG_NOTHING(expr) do { (void)sizeof(std::declval<std::ostream&>() << expr); } while (0)
+
+#if FMF_LOG_LEVEL <= FMF_LEVEL_DEBUG
+#define FMF_LOG_DEBUG(expr) FMF_LOG_WRITE(stdout, expr)
+#else
+#define FMF_LOG_DEBUG(expr) FMF_LOG_NOTHING(expr)
+#endif
+
+#if FMF_LOG_LEVEL <= FMF_LEVEL_INFO
+#define FMF_LOG_INFO(expr) FMF_LOG_WRITE(stdout, expr)
+#define FMF_LOG_INFO_SAMPLED(expr)                                                  \
+    do {                                                                            \
+        static std::atomic<uint64_t> fmf_calls_{0};                                 \
+        if (fmf_calls_.fetch_add(1, std::memory_order_relaxed) % fmf_log::sample_every() == 0) \
+            FMF_LOG_WRITE(stdout, expr);                                            \
+    } while (0)
+#else
+#define FMF_LOG_INFO(expr) FMF_LOG_NOTHING(expr)
+#define FMF_LOG_INFO_SAMPLED(expr) FMF_LOG_NOTHING(expr)
+#endif
+
+#if FMF_LOG_LEVEL <= FMF_LEVEL_WARN
+#define FMF_LOG_WARN(expr) FMF_LOG_WRITE(stderr, expr)
+#else
+#define FMF_LOG_WARN(expr) FMF_LOG_NOTHING(expr)
+#endif
+
+#if FMF_LOG_LEVEL <= FMF_LEVEL_ERROR
+#define FMF_LOG_ERROR(expr) FMF_LOG_WRITE(stderr, expr)
+#else
+#define FMF_LOG_ERROR(expr) FMF_LOG_NOTHING(expr)
+#endif
+
+#endif // FMF_LOG_H
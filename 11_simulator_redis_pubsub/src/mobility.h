@@ -0,0 +1,145 @@
+#ifndef FMF_MOBILITY_H
+#define FMF_MOBILITY_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+//
+// Mobility model for simulated clients (client --load).
+//
+// Random waypoint: each person walks in a straight line at their own
+// speed to a random target in the area, pauses there for a while, then
+// picks the next target. In MANHATTAN mode targets are on the same street
+// of a square grid, so people only ever move along streets.
+//
+// State is kept as structure-of-arrays in local metres (x east, y north
+// of the area's south-west corner). step() is one branch-free loop over
+// plain float arrays that the compiler vectorizes. GCC needs -O3
+// -fno-math-errno -fno-trapping-math for that (sqrt and the selects
+// otherwise count as control flow); add -march=native for AVX. Arrivals
+// are only flagged there; choosing the next waypoint needs the RNG and
+// runs afterwards in a scalar loop over the few people who arrived.
+//
+enum class MobilityMode { RANDOM_WAYPOINT, MANHATTAN };
+
+struct MobilityParams {
+    MobilityMode mode = MobilityMode::RANDOM_WAYPOINT;
+    double lat0 = 37.70;          // south-west corner of the area
+    double lon0 = -122.51;
+    float width_m = 10000.0f;
+    float height_m = 10000.0f;
+    float min_speed = 0.5f;       // m/s
+    float max_speed = 2.0f;
+    float max_pause_s = 60.0f;
+    float block_m = 100.0f;       // street spacing in MANHATTAN mode
+};
+
+class Mobility {
+public:
+    Mobility(size_t n, const MobilityParams& p = MobilityParams(), uint32_t seed = 12345)
+        : p_(p), rng_(seed),
+          x_(n), y_(n), tx_(n), ty_(n), speed_(n), pause_(n), arrived_(n, 0) {
+        m_per_deg_lat_ = 111320.0;
+        m_per_deg_lon_ = 111320.0 * std::cos(p_.lat0 * 3.14159265358979323846 / 180.0);
+        std::uniform_real_distribution<float> pause(0.0f, p_.max_pause_s);
+        for (size_t i = 0; i < n; ++i) {
+            random_point(x_[i], y_[i]);
+            pause_[i] = pause(rng_);
+            retarget(i);
+        }
+    }
+
+    size_t size() const { return x_.size(); }
+
+    // Advance everyone by `dt` seconds; returns how many reached a waypoint
+    size_t step(float dt) {
+        const size_t n = size();
+        move(n, dt, x_.data(), y_.data(), tx_.data(), ty_.data(), speed_.data(), pause_.data(), arrived_.data());
+
+        size_t count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (arrived_[i]) {
+                retarget(i);
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    double lat(size_t i) const { return p_.lat0 + y_[i] / m_per_deg_lat_; }
+    double lon(size_t i) const { return p_.lon0 + x_[i] / m_per_deg_lon_; }
+
+private:
+    // The vectorized kernel. A free function with restrict parameters,
+    // since GCC ignores restrict on local pointers and would otherwise
+    // give up on the alias checks between the seven arrays.
+    static void move(size_t n, float dt, float* __restrict x, float* __restrict y,
+                     const float* __restrict tx, const float* __restrict ty, const float* __restrict speed,
+                     float* __restrict pause, uint8_t* __restrict arrived) {
+        for (size_t i = 0; i < n; ++i) {
+            float dx = tx[i] - x[i];
+            float dy = ty[i] - y[i];
+            float dist = std::sqrt(dx * dx + dy * dy);
+            float wait = pause[i];
+            float step = speed[i] * dt;
+            float travel = wait > 0.0f ? 0.0f : step;
+            // Fraction of the remaining way covered this tick, capped at 1
+            // (computed unconditionally: a guarded division is a branch)
+            float ratio = travel / (dist + 1e-6f);
+            float frac = ratio < 1.0f ? ratio : 1.0f;
+            x[i] += dx * frac;
+            y[i] += dy * frac;
+            pause[i] = wait - dt;
+            arrived[i] = (wait <= 0.0f) & (dist <= travel);
+        }
+    }
+
+    void random_point(float& x, float& y) {
+        std::uniform_real_distribution<float> ux(0.0f, p_.width_m), uy(0.0f, p_.height_m);
+        x = ux(rng_);
+        y = uy(rng_);
+        if (p_.mode == MobilityMode::MANHATTAN) {
+            // Start on a street: snap one coordinate to the grid
+            if (rng_() & 1) x = std::round(x / p_.block_m) * p_.block_m;
+            else y = std::round(y / p_.block_m) * p_.block_m;
+        }
+    }
+
+    // Pick the next waypoint and speed; the pause before leaving is set here
+    void retarget(size_t i) {
+        std::uniform_real_distribution<float> speed(p_.min_speed, p_.max_speed), pause(0.0f, p_.max_pause_s);
+        speed_[i] = speed(rng_);
+        if (pause_[i] <= 0.0f) pause_[i] = pause(rng_);
+        if (p_.mode == MobilityMode::RANDOM_WAYPOINT) {
+            random_point(tx_[i], ty_[i]);
+            return;
+        }
+        // Along the current street to an intersection, or onto the
+        // crossing street when standing on one
+        float gx = std::round(x_[i] / p_.block_m) * p_.block_m;
+        float gy = std::round(y_[i] / p_.block_m) * p_.block_m;
+        bool on_vertical = std::fabs(x_[i] - gx) < 0.01f;
+        bool on_horizontal = std::fabs(y_[i] - gy) < 0.01f;
+        bool go_vertical = on_vertical && (!on_horizontal || (rng_() & 1));
+        std::uniform_int_distribution<int> bx(0, static_cast<int>(p_.width_m / p_.block_m));
+        std::uniform_int_distribution<int> by(0, static_cast<int>(p_.height_m / p_.block_m));
+        if (go_vertical) {
+            tx_[i] = gx;
+            ty_[i] = by(rng_) * p_.block_m;
+        } else {
+            tx_[i] = bx(rng_) * p_.block_m;
+            ty_[i] = on_horizontal ? gy : y_[i];
+        }
+    }
+
+    MobilityParams p_;
+    std::mt19937 rng_;
+    double m_per_deg_lat_, m_per_deg_lon_;
+    std::vector<float> x_, y_, tx_, ty_, speed_, pause_;
+    std::vector<uint8_t> arrived_;
+};
+
+#endif // FMF_MOBILITY_H
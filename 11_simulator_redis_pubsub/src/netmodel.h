@@ -0,0 +1,213 @@
+#ifndef FMF_NETMODEL_H
+#define FMF_NETMODEL_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//
+// Transport models for the virtual-time simulator (sim.cpp).
+//
+// A link delays each message by a sample from its LatencyModel and may
+// drop it according to its LossModel. Both draw from a seeded Rng, so a
+// run is reproducible from its seed and options.
+//
+// Models are given as "kind:param:..." strings:
+//
+//   latency  const:US | uniform:MIN_US:MAX_US | lognormal:MEDIAN_US:SIGMA
+//   loss     none | bernoulli:P | ge:P_GB:P_BG:LOSS_BAD
+//
+// "ge" is a Gilbert-Elliott channel: a good state without loss and a bad
+// state that loses LOSS_BAD of its messages, switching good->bad with
+// probability P_GB and bad->good with P_BG per message, which gives the
+// bursty loss of a congested or flapping link.
+//
+
+// xoshiro256** seeded through splitmix64
+class Rng {
+public:
+    explicit Rng(uint64_t seed) {
+        for (auto& s : s_) {
+            seed += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            s = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(s_[1] * 5, 7) * 9;
+        uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return result;
+    }
+
+    // Uniform in [0, 1)
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    // Uniform in [0, n)
+    uint64_t below(uint64_t n) { return static_cast<uint64_t>((static_cast<unsigned __int128>(next()) * n) >> 64); }
+
+private:
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+    uint64_t s_[4];
+};
+
+namespace netmodel_detail {
+
+inline std::vector<std::string> split(const std::string& spec) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    for (;;) {
+        size_t colon = spec.find(':', start);
+        parts.push_back(spec.substr(start, colon - start));
+        if (colon == std::string::npos) return parts;
+        start = colon + 1;
+    }
+}
+
+inline double number(const std::string& s, const std::string& spec) {
+    char* end;
+    double v = std::strtod(s.c_str(), &end);
+    if (s.empty() || *end) throw std::invalid_argument("bad number '" + s + "' in '" + spec + "'");
+    return v;
+}
+
+// Standard normal quantile, by bisection on erfc (only used to build tables)
+inline double normal_quantile(double p) {
+    double lo = -40, hi = 40;
+    for (int i = 0; i < 64; ++i) {
+        double mid = (lo + hi) / 2;
+        (0.5 * std::erfc(-mid / std::sqrt(2.0)) < p ? lo : hi) = mid;
+    }
+    return (lo + hi) / 2;
+}
+
+} // namespace netmodel_detail
+
+//
+// Latency in microseconds. Lognormal samples come from a precomputed
+// quantile table, which keeps a sample to one table lookup.
+//
+class LatencyModel {
+public:
+    explicit LatencyModel(const std::string& spec = "const:0") : spec_(spec) {
+        using namespace netmodel_detail;
+        std::vector<std::string> p = split(spec);
+        if (p[0] == "const" && p.size() == 2) {
+            kind_ = CONST;
+            a_ = number(p[1], spec);
+        } else if (p[0] == "uniform" && p.size() == 3) {
+            kind_ = UNIFORM;
+            a_ = number(p[1], spec);
+            b_ = number(p[2], spec);
+            if (b_ < a_) throw std::invalid_argument("uniform max below min in '" + spec + "'");
+        } else if (p[0] == "lognormal" && p.size() == 3) {
+            kind_ = TABLE;
+            double median = number(p[1], spec), sigma = number(p[2], spec);
+            table_.resize(TABLE_SIZE);
+            for (size_t i = 0; i < TABLE_SIZE; ++i)
+                table_[i] = median * std::exp(sigma * normal_quantile((i + 0.5) / TABLE_SIZE));
+        } else {
+            throw std::invalid_argument("unknown latency model '" + spec + "'");
+        }
+        if (a_ < 0) throw std::invalid_argument("negative latency in '" + spec + "'");
+    }
+
+    int64_t sample(Rng& rng) const {
+        switch (kind_) {
+            case CONST: return static_cast<int64_t>(a_);
+            case UNIFORM: return static_cast<int64_t>(a_ + rng.uniform() * (b_ - a_));
+            default: return static_cast<int64_t>(table_[rng.next() >> (64 - TABLE_BITS)]);
+        }
+    }
+
+    const std::string& spec() const { return spec_; }
+
+private:
+    enum Kind { CONST, UNIFORM, TABLE };
+    static const int TABLE_BITS = 12;
+    static const size_t TABLE_SIZE = size_t(1) << TABLE_BITS;
+
+    std::string spec_;
+    Kind kind_ = CONST;
+    double a_ = 0, b_ = 0;
+    std::vector<double> table_;
+};
+
+//
+// Per-message loss. Gilbert-Elliott keeps state, so each link needs its
+// own LossModel instance.
+//
+class LossModel {
+public:
+    explicit LossModel(const std::string& spec = "none") : spec_(spec) {
+        using namespace netmodel_detail;
+        std::vector<std::string> p = split(spec);
+        if (p[0] == "none" && p.size() == 1) {
+            kind_ = NONE;
+        } else if (p[0] == "bernoulli" && p.size() == 2) {
+            kind_ = BERNOULLI;
+            loss_ = number(p[1], spec);
+        } else if (p[0] == "ge" && p.size() == 4) {
+            kind_ = GILBERT_ELLIOTT;
+            p_gb_ = number(p[1], spec);
+            p_bg_ = number(p[2], spec);
+            loss_ = number(p[3], spec);
+        } else {
+            throw std::invalid_argument("unknown loss model '" + spec + "'");
+        }
+    }
+
+    bool lost(Rng& rng) {
+        switch (kind_) {
+            case NONE: return false;
+            case BERNOULLI: return rng.uniform() < loss_;
+            default:
+                bad_ = bad_ ? rng.uniform() >= p_bg_ : rng.uniform() < p_gb_;
+                return bad_ && rng.uniform() < loss_;
+        }
+    }
+
+    const std::string& spec() const { return spec_; }
+
+private:
+    enum Kind { NONE, BERNOULLI, GILBERT_ELLIOTT };
+
+    std::string spec_;
+    Kind kind_ = NONE;
+    double loss_ = 0, p_gb_ = 0, p_bg_ = 0;
+    bool bad_ = false;
+};
+
+// One hop between two stages
+struct Link {
+    LatencyModel latency;
+    LossModel loss;
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+
+    Link(const std::string& latency_spec, const std::string& loss_spec)
+        : latency(latency_spec), loss(loss_spec) {}
+
+    // Delay for a message, or -1 if the link drops it
+    int64_t transmit(Rng& rng) {
+        ++sent;
+        if (loss.lost(rng)) {
+            ++dropped;
+            return -1;
+        }
+        return latency.sample(rng);
+    }
+};
+
+#endif // FMF_NETMODEL_H
@@ -5,60 +5,196 @@
 
 // receiver.cpp
 #include <cpp_redis/cpp_redis>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
-#include <vector>
+#include <map>
 #include <mutex>
+#include <csignal>
+#include <atomic>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+#include "credits.h"
+#include "friends.h"
+#include "log.h"
+#include "trace.h"
+
+std::atomic<bool> running{true};
+
+void signal_handler(int) {
+    running = false;
+}
+
+// Timestamps we look at per message: send + one per traced server hop
+static const int MAX_STAMPS = 8;
+// Hop names when both servers ran with --trace
+static const char* HOP_NAMES[] = {"client->ingest", "ingest->forward", "forward->receiver"};
+
+//
+// Latency histograms: end-to-end (client send -> here) and one per hop
+//
+struct LatencyStats {
+    LatencyHistogram e2e;
+    std::vector<LatencyHistogram> hops;
+    int full_hops = 0;   // number of stamps seen on fully traced messages
+
+    void record(const int64_t* stamps, int n, int64_t arrived) {
+        e2e.record(arrived - stamps[0]);
+        if ((int)hops.size() < n) hops.resize(n);
+        for (int i = 0; i < n; ++i) {
+            int64_t next = (i + 1 < n) ? stamps[i + 1] : arrived;
+            hops[i].record(next - stamps[i]);
+        }
+        full_hops = std::max(full_hops, n);
+    }
+
+    void print(std::ostream& os) const {
+        os << "\n[receiver] latency:\n";
+        e2e.print(os, "end-to-end");
+        for (size_t i = 0; i < hops.size(); ++i) {
+            bool named = full_hops == 3 && i < 3;
+            hops[i].print(os, named ? HOP_NAMES[i] : "hop" + std::to_string(i + 1));
+        }
+        os.flush();
+    }
+};
+
+int main(int argc, char** argv) {
+    // [--stats-interval S]: also dump latency histograms every S seconds
+    // [--credits [--credit-window N]]: grant server_forward one credit per
+    //     message handled, so it never has more than N in flight to us
+    // [--delay-us US]: spend US per message, to play a slow receiver
+    int argi = 1;
+    int stats_interval = 0;
+    bool credits = false;
+    int64_t credit_window = CREDIT_WINDOW;
+    int delay_us = 0;
+    while (argi < argc && std::string(argv[argi]).compare(0, 2, "--") == 0) {
+        std::string flag = argv[argi];
+        if (flag == "--credits") {
+            credits = true;
+            argi += 1;
+            continue;
+        }
+        if (argi + 1 >= argc) break;
+        if (flag == "--stats-interval") stats_interval = std::atoi(argv[argi + 1]);
+        else if (flag == "--credit-window") credit_window = std::max<int64_t>(1, std::atoll(argv[argi + 1]));
+        else if (flag == "--delay-us") delay_us = std::atoi(argv[argi + 1]);
+        else break;
+        argi += 2;
+    }
+
+    // With a user id, listen only to my friends' updates on my own channel;
+    // without one, listen to the broadcast channel
+    std::string channel = "locations_out";
+    int me = -1;
+    if (argi < argc) {
+        me = std::stoi(argv[argi]);
+        channel = user_channel(me);
+    }
+
+    signal(SIGINT, signal_handler);
 
-int main() {
     cpp_redis::subscriber redis_subscriber;
     redis_subscriber.connect();
+    FMF_LOG_INFO("[receiver] Subscribing to " << channel);
 
     // known[0] -> client0's latest message
     // known[1] -> client1's latest message
-    // known[2] -> client2's latest message
-    // known[3] -> client3's latest message
-    // known[4] -> client4's latest message
-    std::vector<std::string> known(5, "");
+    // ...
+    std::map<int, std::string> known;
+    LatencyStats latency;
     std::mutex mtx;
+    CreditGranter granter(credit_window);
+    uint64_t handled = 0;
 
-    redis_subscriber.subscribe("locations_out",
+    redis_subscriber.subscribe(channel,
         //
         // --- START OF CALLBACK FUNCTION ---
         //
         // This is a lambda function that acts as the callback.
         // It captures variables by reference [&] so it can access `mtx` and `known`.
-        [&](const std::string& chan, const std::string& msg) {
+        [&](const std::string&, const std::string& msg) {
 
             //
             // --- Parse the incoming message ---
             //
 
-            // parse "id,lat,lon"
+            // parse "id,lat,lon[,t_send[,t_hop...]]"
+            int64_t arrived = now_us();
             auto pos = msg.find(',');
             if (pos == std::string::npos) return;
             int id = std::stoi(msg.substr(0, pos));
+            int64_t stamps[MAX_STAMPS];
+            int n = parse_trace(msg, stamps, MAX_STAMPS);
 
             //
             // --- Update shared state safely ---
             //
             {
                 std::lock_guard<std::mutex> lk(mtx);
-                if (id >= 0 && id < 5) known[id] = msg;
+                if (id >= 0) known[id] = msg;
+                if (n > 0) latency.record(stamps, n, arrived);
+                ++handled;
             }
+            if (delay_us > 0) std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+            granter.consumed();
 
             //
-            // --- Print the latest known positions ---
+            // --- Print the latest known positions (sampled: only formatted
+            // when this call is logged) ---
             //
-            std::cout << "\n[receiver] latest positions:\n";
-            for (int i = 0; i < 5; ++i) {
+            auto positions = [&]() {
                 std::lock_guard<std::mutex> lk(mtx);
-                if (!known[i].empty()) std::cout << "  " << known[i] << "\n";
-                else std::cout << "  " << i << " -> (no data yet)\n";
-            }
+                std::string out;
+                if (known.empty()) out += "\n  (no data yet)";
+                for (auto& kv : known) out += "\n  " + kv.second;
+                return out;
+            };
+            FMF_LOG_INFO_SAMPLED("\n[receiver] latest positions:" << positions());
         });
 
     redis_subscriber.commit();
-    // Shut down if we are idle for 60 seconds
-    while (true) std::this_thread::sleep_for(std::chrono::seconds(60));
+
+    // Credits for server_forward and fmf.stats
+    cpp_redis::client ctl;
+    ctl.connect();
+    std::string credit_channel = receiver_credit_channel(me);
+    std::string stats_name = "receiver." + (me < 0 ? std::string("all") : std::to_string(me));
+
+    // Run until Ctrl-C, dumping latency every stats_interval seconds
+    auto last_dump = std::chrono::steady_clock::now();
+    auto last_stats = last_dump;
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(credits ? CREDIT_GRANT_MS : 100));
+        auto now = std::chrono::steady_clock::now();
+        if (credits) {
+            int64_t n = granter.due(true);
+            if (n > 0) ctl.publish(credit_channel, grant_message(n, credit_window), nullptr);
+        }
+        if (now - last_stats >= std::chrono::seconds(5)) {
+            std::ostringstream line;
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                line << "handled=" << handled << " known=" << known.size();
+            }
+            ctl.publish(STATS_CHANNEL, stats_name + " " + line.str(), nullptr);
+            last_stats = now;
+        }
+        ctl.commit();
+        if (stats_interval > 0 && now - last_dump >= std::chrono::seconds(stats_interval)) {
+            std::lock_guard<std::mutex> lk(mtx);
+            latency.print(std::cout);
+            last_dump = now;
+        }
+    }
+
+    redis_subscriber.disconnect();
+    ctl.disconnect();
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        latency.print(std::cout);
+    }
     return 0;
 }
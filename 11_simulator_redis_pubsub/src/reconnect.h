@@ -0,0 +1,199 @@
+#ifndef FMF_RECONNECT_H
+#define FMF_RECONNECT_H
+
+#include <cpp_redis/cpp_redis>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "coalesce.h"
+#include "log.h"
+
+//
+// Exponential backoff with full jitter: the n-th retry waits a random time
+// in [0, min(cap, base * 2^n)]. The randomness keeps a fleet of clients
+// that lost Redis at the same moment from reconnecting in lockstep.
+//
+class Backoff {
+public:
+    Backoff(int base_ms = 50, int cap_ms = 5000)
+        : base_ms_(base_ms), cap_ms_(cap_ms), rng_(std::random_device{}()) {}
+
+    std::chrono::milliseconds next() {
+        long ceiling = std::min<long>(cap_ms_, static_cast<long>(base_ms_) << std::min(attempt_, 20));
+        ++attempt_;
+        std::uniform_int_distribution<long> d(0, ceiling);
+        return std::chrono::milliseconds(d(rng_));
+    }
+
+    void reset() { attempt_ = 0; }
+
+private:
+    int base_ms_, cap_ms_;
+    int attempt_ = 0;
+    std::mt19937 rng_;
+};
+
+//
+// A cpp_redis::client that (re)connects on a background thread, so the
+// thread producing updates never blocks on Redis being down. Producers
+// check connected() and buffer while it is false.
+//
+// The client may only be used while holding lock(), which the connector
+// thread also takes while (re)connecting.
+//
+class ReconnectingClient {
+public:
+    explicit ReconnectingClient(std::string who, std::string host = "127.0.0.1", int port = 6379)
+        : who_(std::move(who)), host_(std::move(host)), port_(port) {}
+
+    ~ReconnectingClient() { stop(); }
+
+    void start() {
+        thread_ = std::thread([this]() { loop(); });
+    }
+
+    void stop() {
+        if (stop_.exchange(true)) return;
+        if (thread_.joinable()) thread_.join();
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (client_.is_connected()) client_.disconnect();
+    }
+
+    bool connected() const { return connected_; }
+    std::mutex& lock() { return mtx_; }
+    cpp_redis::client& client() { return client_; }
+
+    // A command failed: have the connector thread reconnect
+    void mark_dropped() { connected_ = false; }
+
+private:
+    void loop() {
+        Backoff backoff;
+        while (!stop_) {
+            if (connected_) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                continue;
+            }
+            try {
+                std::lock_guard<std::mutex> lk(mtx_);
+                if (client_.is_connected()) client_.disconnect();
+                client_.connect(host_, port_,
+                    [this](const std::string&, std::size_t, cpp_redis::client::connect_state s) {
+                        if (s == cpp_redis::client::connect_state::dropped) connected_ = false;
+                    }, CONNECT_TIMEOUT_MS);
+                connected_ = true;
+                backoff.reset();
+                FMF_LOG_INFO("[" << who_ << "] Connected to Redis.");
+            } catch (const cpp_redis::redis_error &e) {
+                auto wait = backoff.next();
+                FMF_LOG_WARN("[" << who_ << "] Redis not ready, retrying in " << wait.count() << "ms...");
+                // Sleep in slices so stop() stays responsive
+                auto until = std::chrono::steady_clock::now() + wait;
+                while (!stop_ && std::chrono::steady_clock::now() < until)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+    }
+
+    static const uint32_t CONNECT_TIMEOUT_MS = 1000;
+
+    std::string who_, host_;
+    int port_;
+    cpp_redis::client client_;
+    std::mutex mtx_;
+    std::thread thread_;
+    std::atomic<bool> connected_{false};
+    std::atomic<bool> stop_{false};
+};
+
+//
+// Updates handed to Redis but not yet answered. Each one is settled
+// exactly once: by its reply, or by drain_pending() if queuing or
+// committing the batch threw.
+//
+struct InFlightBatch {
+    explicit InFlightBatch(size_t n) : updates(n), settled(new std::atomic<bool>[n]) {
+        for (size_t i = 0; i < n; ++i) settled[i] = false;
+    }
+
+    // Put update i back into `buffer` unless it was already settled
+    void restore(size_t i, CoalescingBuffer& buffer) {
+        if (!settled[i].exchange(true)) buffer.restore(updates[i].first, std::move(updates[i].second));
+    }
+
+    std::vector<std::pair<int, std::string>> updates;
+    std::unique_ptr<std::atomic<bool>[]> settled;
+};
+
+//
+// Send everything pending in `buffer` (at most `limit` updates) through
+// `rc`, `batch_size` updates per pipelined commit. send(client, msg,
+// callback) queues one update and passes `callback` on as its reply
+// callback. Does nothing while disconnected (the buffer keeps
+// coalescing). Returns the number of updates handed to Redis.
+//
+// Delivery is tracked through the replies, which cpp_redis runs on its
+// own thread: an update whose reply is an error - including the
+// "network failure" reply every outstanding command gets when the
+// connection drops mid-pipeline - goes back into the buffer, unless a
+// newer update for that client has arrived. If queuing or committing a
+// batch throws, the rest of it goes back the same way and the connection
+// is marked dropped. `buffer` must outlive the connection.
+//
+template <typename Send>
+size_t drain_pending(ReconnectingClient& rc, CoalescingBuffer& buffer,
+                     std::vector<std::pair<int, std::string>>& scratch,
+                     size_t batch_size, Send&& send, size_t limit = SIZE_MAX) {
+    if (!rc.connected()) return 0;
+    std::unique_lock<std::mutex> lk(rc.lock(), std::try_to_lock);
+    if (!lk.owns_lock()) return 0;   // reconnecting right now
+
+    buffer.drain(scratch, limit);
+    size_t sent = 0;
+    while (sent < scratch.size()) {
+        size_t end = std::min(scratch.size(), sent + batch_size);
+        auto batch = std::make_shared<InFlightBatch>(end - sent);
+        for (size_t i = sent; i < end; ++i) batch->updates[i - sent] = std::move(scratch[i]);
+        try {
+            for (size_t i = 0; i < batch->updates.size(); ++i) {
+                send(rc.client(), batch->updates[i].second, [batch, i, &buffer](cpp_redis::reply& r) {
+                    if (r.is_error()) batch->restore(i, buffer);
+                    else batch->settled[i] = true;
+                });
+            }
+            rc.client().commit();
+        } catch (const cpp_redis::redis_error &e) {
+            rc.mark_dropped();
+            for (size_t i = 0; i < batch->updates.size(); ++i) batch->restore(i, buffer);
+            for (size_t i = end; i < scratch.size(); ++i)
+                buffer.restore(scratch[i].first, std::move(scratch[i].second));
+            break;
+        }
+        sent = end;
+    }
+    return sent;
+}
+
+// Publish one message if the connection is up and free right now (for
+// periodic, best-effort messages such as stats)
+inline void try_publish(ReconnectingClient& rc, const std::string& channel, const std::string& msg) {
+    if (!rc.connected()) return;
+    std::unique_lock<std::mutex> lk(rc.lock(), std::try_to_lock);
+    if (!lk.owns_lock()) return;
+    try {
+        rc.client().publish(channel, msg, nullptr);
+        rc.client().commit();
+    } catch (const cpp_redis::redis_error &e) {
+        rc.mark_dropped();
+    }
+}
+
+#endif // FMF_RECONNECT_H
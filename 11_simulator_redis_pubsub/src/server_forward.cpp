@@ -4,6 +4,25 @@
 #include <chrono>
 #include <csignal>
 #include <atomic>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+#include "coalesce.h"
+#include "credits.h"
+#include "friends.h"
+#include "log.h"
+#include "shard.h"
+#include "spsc_queue.h"
+#include "streams.h"
+#include "trace.h"
+
+// Max commands buffered in the publisher before a commit (one pipelined write)
+static const int FANOUT_BATCH = 512;
+// Max messages a worker takes off its queue before committing
+static const int DRAIN_BATCH = 256;
 
 std::atomic<bool> running{true};
 
@@ -11,67 +30,418 @@ void signal_handler(int) {
     running = false;
 }
 
-int main() {
-    std::cout << "[server_forward] Starting up..." << std::endl;
-    std::cout.flush();
-
-    signal(SIGINT, signal_handler);
-
-    cpp_redis::subscriber sub;
-    cpp_redis::client pub;
-
-    // Connect pub and sub, retry if Redis is not ready
+// Connect, retrying until Redis is up (or we are interrupted)
+template <typename Conn>
+static bool connect_with_retry(Conn& c, const char* what) {
     while (running) {
         try {
-            pub.connect("127.0.0.1", 6379);
-            std::cout << "[server_forward] Publisher connected to Redis." << std::endl;
-            std::cout.flush();
-            break;
+            c.connect("127.0.0.1", 6379);
+            FMF_LOG_INFO("[server_forward] " << what << " connected to Redis.");
+            return true;
         } catch(const cpp_redis::redis_error &e) {
-            std::cerr << "[server_forward] Publisher connection failed, retrying..." << std::endl;
-            std::cerr.flush();
+            FMF_LOG_WARN("[server_forward] " << what << " connection failed, retrying...");
             std::this_thread::sleep_for(std::chrono::seconds(1));
         }
     }
+    return false;
+}
 
-    while (running) {
-        try {
-            sub.connect("127.0.0.1", 6379);
-            std::cout << "[server_forward] Subscriber connected to Redis." << std::endl;
-            std::cout.flush();
-            break;
-        } catch(const cpp_redis::redis_error &e) {
-            std::cerr << "[server_forward] Subscriber connection failed, retrying..." << std::endl;
-            std::cerr.flush();
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+//
+// Where a message goes: every friend's channel, or the broadcast channel
+//
+struct Router {
+    FriendGraph friends;
+    std::vector<std::string> channels;   // user id -> locations_out.<id>
+    std::string broadcast = "locations_out";
+
+    bool fanout() const { return !channels.empty(); }
+
+    // Destination -1 is the broadcast channel
+    const std::string& channel(int dest) const { return dest < 0 ? broadcast : channels[dest]; }
+
+    // Call f(dest) for every destination of the update from client `id`
+    template <typename F>
+    void for_each_destination(int id, F&& f) const {
+        if (!fanout()) {
+            f(-1);
+            return;
         }
+        if (!friends.has_user(id)) return;
+        for (const int* fr = friends.friends_begin(id); fr != friends.friends_end(id); ++fr) f(*fr);
     }
+};
 
-    sub.subscribe("locations_mid", [&](const std::string& chan, const std::string& msg){
-        std::cout << "[server_forward] Received: " << msg << std::endl;
-        std::cout.flush();
-        try {
-            pub.publish("locations_out", msg);
+//
+// Credits granted by the receivers, one gate per destination (slot 0 is
+// the broadcast channel). Shared by all workers.
+//
+struct ReceiverCredits {
+    explicit ReceiverCredits(int num_users) : gates(num_users + 1) {}
+
+    std::vector<CreditGate> gates;
+
+    bool has(int dest) const { return dest + 1 < static_cast<int>(gates.size()); }
+    CreditGate& gate(int dest) { return gates[dest + 1]; }
+};
+
+// A message handed to a worker. stream_id is set when it was read from
+// the Redis stream and still needs to be acknowledged.
+struct Item {
+    std::string msg;
+    std::string stream_id;
+};
+
+//
+// One forwarding worker: its own publisher connection, fed by the
+// subscriber callback (or stream reader) through a lock-free SPSC queue.
+// A client id always maps to the same worker, so per-client order is kept
+// while different clients are published in parallel.
+//
+// With credits, a destination whose receiver has no credits left gets
+// its updates held here instead, latest per client, and they go out as
+// credits come in. Once something is held for a destination, newer
+// updates queue behind it so a client's positions never go backwards.
+// A stream entry is acknowledged only once every copy of it has been
+// published (or replaced by a newer update for the same client), so a
+// crash never loses what was held.
+//
+struct Worker {
+    Worker(size_t queue_size, const Router& router, ReceiverCredits* credits, CreditGranter* granter)
+        : queue(queue_size), router(router), credits(credits), granter(granter) {}
+
+    SpscQueue<Item> queue;
+    cpp_redis::client pub;
+    std::thread thread;
+    std::atomic<uint64_t> forwarded{0};
+    std::atomic<size_t> held_total{0};
+
+    const Router& router;
+    ReceiverCredits* credits;    // null without --credits
+    CreditGranter* granter;      // grants to server_ingest, null without --credits
+    std::unordered_map<int, CoalescingBuffer> held;   // destination -> updates waiting for credits
+    std::vector<int> waiting;                          // destinations with something held
+    std::vector<std::pair<int, std::string>> scratch;
+    std::vector<std::string> acks;                     // stream ids to XACK with the next commit
+    std::unordered_map<std::string, int> unacked;      // stream id -> copies still held
+    std::unordered_map<int, std::unordered_map<int, std::string>> held_ids;   // dest -> client -> stream id
+
+    // One held copy of a stream entry is out (published or replaced)
+    void settle(const std::string& stream_id) {
+        auto it = unacked.find(stream_id);
+        if (it == unacked.end()) return;
+        if (--it->second == 0) {
+            acks.push_back(it->first);
+            unacked.erase(it);
+        }
+    }
+
+    // Queue one publish; returns how many commands are still uncommitted
+    int publish(int dest, const std::string& msg, int pending) {
+        pub.publish(router.channel(dest), msg, nullptr);
+        if (++pending == FANOUT_BATCH) {
             pub.commit();
-            std::cout << "[server_forward] Forwarded to locations_out: " << msg << std::endl;
-            std::cout.flush();
-        } catch(const cpp_redis::redis_error &e) {
-            std::cerr << "[server_forward] Publish failed: " << e.what() << std::endl;
-            std::cerr.flush();
+            pending = 0;
         }
-    });
+        return pending;
+    }
+
+    // "id,lat,lon,..." -> every destination, or held when out of credits
+    int route(const std::string& msg, std::string&& stream_id, int pending) {
+        int id = std::atoi(msg.c_str());
+        int holds = 0;
+        router.for_each_destination(id, [&](int dest) {
+            if (!credits || !credits->has(dest)) {
+                pending = publish(dest, msg, pending);
+                return;
+            }
+            auto it = held.find(dest);
+            bool backlog = it != held.end() && it->second.size() > 0;
+            if (!backlog && credits->gate(dest).take(1) == 1) {
+                pending = publish(dest, msg, pending);
+                return;
+            }
+            if (!backlog) waiting.push_back(dest);
+            if (!held[dest].put(id, msg) || stream_id.empty()) return;
+            std::string& slot = held_ids[dest][id];
+            if (slot == stream_id) return;
+            if (!slot.empty()) settle(slot);   // replaced by this newer update
+            slot = stream_id;
+            ++holds;
+        });
+        if (stream_id.empty()) return pending;
+        if (holds) unacked[stream_id] += holds;
+        else acks.push_back(std::move(stream_id));
+        return pending;
+    }
 
-    sub.commit();
+    // Publish held updates the receivers have granted credits for since
+    int release_held(int pending) {
+        size_t total = 0;
+        for (size_t i = 0; i < waiting.size();) {
+            int dest = waiting[i];
+            CoalescingBuffer& buffer = held[dest];
+            int64_t n = credits->gate(dest).take(static_cast<int64_t>(buffer.size()));
+            if (n > 0) {
+                buffer.drain(scratch, static_cast<size_t>(n));
+                auto ids = held_ids.find(dest);
+                for (auto& update : scratch) {
+                    pending = publish(dest, update.second, pending);
+                    if (ids == held_ids.end()) continue;
+                    auto slot = ids->second.find(update.first);
+                    if (slot == ids->second.end()) continue;
+                    settle(slot->second);
+                    ids->second.erase(slot);
+                }
+            }
+            if (buffer.size() == 0) {
+                waiting[i] = waiting.back();
+                waiting.pop_back();
+            } else {
+                total += buffer.size();
+                ++i;
+            }
+        }
+        held_total = total;
+        return pending;
+    }
 
-    std::cout << "[server_forward] Ready, waiting for messages..." << std::endl;
-    std::cout.flush();
+    void run() {
+        Item item;
+        while (running) {
+            int taken = 0, pending = 0;
+            try {
+                if (!waiting.empty()) pending = release_held(pending);
+                while (taken < DRAIN_BATCH && queue.try_pop(item)) {
+                    pending = route(item.msg, std::move(item.stream_id), pending);
+                    FMF_LOG_INFO_SAMPLED("[server_forward] Forwarded: " << item.msg);
+                    ++taken;
+                }
+                // Acknowledge stream entries only once all their publishes
+                // are queued, in the same pipelined write
+                if (!acks.empty()) {
+                    pub.send(xack_cmd(STREAM_MID, FORWARD_GROUP, acks), nullptr);
+                    acks.clear();
+                    ++pending;
+                }
+                if (pending) pub.commit();
+            } catch(const cpp_redis::redis_error &e) {
+                FMF_LOG_ERROR("[server_forward] Publish failed: " << e.what());
+            }
+            forwarded += taken;
+            if (granter) granter->consumed(taken);
+            if (taken == 0) std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+};
 
-    while (running) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+int main(int argc, char** argv) {
+    FMF_LOG_INFO("[server_forward] Starting up...");
 
-    sub.unsubscribe("locations_mid");
-    sub.disconnect();
-    pub.disconnect();
-    std::cout << "[server_forward] Shutting down." << std::endl;
-    std::cout.flush();
+    bool trace = false, streams = false, credits = false;
+    int num_workers = 4;
+    int queue_size = 4096;
+    int read_count = 256;
+    int64_t credit_window = CREDIT_WINDOW;
+    std::string consumer = stable_consumer("forward");
+
+    static struct option long_options[] = {
+        {"trace",      no_argument,       0, 't'},
+        {"transport",  required_argument, 0, 'T'},
+        {"consumer",   required_argument, 0, 'c'},
+        {"read-count", required_argument, 0, 'r'},
+        {"workers",    required_argument, 0, 'w'},
+        {"queue-size", required_argument, 0, 'q'},
+        {"credits",    no_argument,       0, 'C'},
+        {"credit-window", required_argument, 0, 'W'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    int option_index = 0;
+    while ((opt = getopt_long(argc, argv, "tT:c:r:w:q:CW:", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 't': trace = true; break;   // stamp each message with the time it reached this hop
+            case 'T': streams = std::string(optarg) == "streams"; break;   // pubsub (default) | streams
+            case 'c': consumer = optarg; break;                             // consumer name in the group
+            case 'r': read_count = std::atoi(optarg); break;                // XREADGROUP COUNT
+            case 'w': num_workers = std::atoi(optarg); break;
+            case 'q': queue_size = std::atoi(optarg); break;
+            case 'C': credits = true; break;                                // flow control with ingest and receivers
+            case 'W': credit_window = std::atoll(optarg); break;            // credits granted to ingest
+            default:
+                std::cerr << "Usage: " << argv[0] << " [--trace] [--transport pubsub|streams] [--consumer NAME] [--read-count N]\n"
+                          << "       [--workers N] [--queue-size Q] [--credits [--credit-window N]] [friends.csv]" << std::endl;
+                return 1;
+        }
+    }
+    if (num_workers < 1) num_workers = 1;
+    if (queue_size < 2) queue_size = 2;
+    if (credit_window < 1) credit_window = 1;
+
+    // Optional friend list: fan out to each friend's own channel instead of
+    // broadcasting everything on locations_out
+    Router router;
+    if (optind < argc) {
+        const char* friends_file = argv[optind];
+        if (!router.friends.load(friends_file)) {
+            FMF_LOG_ERROR("[server_forward] Cannot open friends file: " << friends_file);
+            return 1;
+        }
+        // Build channel names once, not per message
+        router.channels.reserve(router.friends.num_users());
+        for (int u = 0; u < router.friends.num_users(); ++u) router.channels.push_back(user_channel(u));
+        FMF_LOG_INFO("[server_forward] Loaded " << router.friends.num_users() << " users, "
+                  << router.friends.targets.size() << " friend links from " << friends_file);
+    }
+
+    signal(SIGINT, signal_handler);
+
+    // Flow control: grants from the receivers, and our own grants to ingest
+    std::unique_ptr<ReceiverCredits> receiver_credits;
+    std::unique_ptr<CreditGranter> granter;
+    cpp_redis::subscriber grants;
+    if (credits) {
+        receiver_credits.reset(new ReceiverCredits(std::max(0, router.friends.num_users())));
+        granter.reset(new CreditGranter(credit_window));
+        connect_with_retry(grants, "Credit subscriber");
+        grants.psubscribe(CREDITS_RECEIVER_PATTERN, [&](const std::string& channel, const std::string& msg) {
+            // credits.receiver.<user> or credits.receiver.all
+            std::string who = channel.substr(channel.rfind('.') + 1);
+            int dest = who == "all" ? -1 : std::atoi(who.c_str());
+            int64_t n, window;
+            if (dest >= -1 && receiver_credits->has(dest) && parse_grant(msg, n, window))
+                receiver_credits->gate(dest).grant(n, window);
+        });
+        grants.commit();
+    }
+
+    // Grants to ingest and fmf.stats go out on their own connection
+    cpp_redis::client ctl;
+    if (!connect_with_retry(ctl, "Control")) return 0;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int i = 0; i < num_workers; ++i) {
+        workers.emplace_back(new Worker(queue_size, router, receiver_credits.get(), granter.get()));
+        if (!connect_with_retry(workers.back()->pub, "Publisher")) return 0;
+    }
+    for (auto& w : workers) w->thread = std::thread(&Worker::run, w.get());
+
+    // Times we had to wait for a full worker queue
+    std::atomic<uint64_t> stalls{0};
+
+    // Same client -> same worker. When that worker's queue is full we wait
+    // here, which stops reading from Redis: backpressure.
+    auto dispatch = [&](Item&& item) {
+        if (trace) append_hop(item.msg);
+        int id = std::atoi(item.msg.c_str());
+        Worker& w = *workers[mix64(static_cast<uint64_t>(id)) % workers.size()];
+        if (!w.queue.try_push(std::move(item))) {
+            ++stalls;
+            while (running && !w.queue.try_push(std::move(item))) std::this_thread::yield();
+        }
+    };
+
+    cpp_redis::subscriber sub;
+    cpp_redis::client reader;
+    std::thread stream_reader;
+
+    if (!streams) {
+        connect_with_retry(sub, "Subscriber");
+        sub.subscribe("locations_mid", [&](const std::string&, const std::string& received){
+            FMF_LOG_DEBUG("[server_forward] Received: " << received);
+            dispatch(Item{received, std::string()});
+        });
+        sub.commit();
+    } else {
+        connect_with_retry(reader, "Stream reader");
+        ensure_group(reader, STREAM_MID, FORWARD_GROUP);
+
+        // First re-read anything delivered to this consumer but never
+        // acknowledged (we crashed), then switch to new entries. Entries
+        // trimmed meanwhile have nothing left to forward and are only acked.
+        stream_reader = std::thread([&]() {
+            std::vector<StreamEntry> entries;
+            std::vector<std::string> trimmed;
+            std::string from_id = "0";
+            while (running) {
+                try {
+                    read_group(reader, STREAM_MID, FORWARD_GROUP, consumer, from_id, read_count, 100, entries);
+                    advance_cursor(from_id, entries);
+                    trimmed.clear();
+                    for (auto& e : entries) {
+                        if (e.trimmed) trimmed.push_back(std::move(e.id));
+                        else dispatch(Item{std::move(e.msg), std::move(e.id)});
+                    }
+                    if (!trimmed.empty()) {
+                        reader.send(xack_cmd(STREAM_MID, FORWARD_GROUP, trimmed), nullptr);
+                        reader.commit();
+                    }
+                } catch (const cpp_redis::redis_error &e) {
+                    FMF_LOG_ERROR("[server_forward] XREADGROUP failed: " << e.what());
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
+                }
+            }
+        });
+    }
+
+    FMF_LOG_INFO("[server_forward] Ready with " << num_workers << " workers"
+              << (streams ? " (streams, consumer " + consumer + ")" : std::string())
+              << (credits ? ", credits on" : "") << ", waiting for messages...");
+
+    auto last_stats = std::chrono::steady_clock::now();
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(credits ? CREDIT_GRANT_MS : 100));
+        size_t queued = 0;
+        for (auto& w : workers) queued += w->queue.size_approx();
+
+        try {
+            // Grant what the workers consumed, but not while their queues
+            // are more than half full
+            if (granter) {
+                int64_t n = granter->due(queued < static_cast<size_t>(queue_size) * workers.size() / 2);
+                if (n > 0) {
+                    ctl.publish(CREDITS_FORWARD, grant_message(n, credit_window), nullptr);
+                    ctl.commit();
+                }
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_stats >= std::chrono::seconds(5)) {
+                uint64_t forwarded = 0;
+                size_t held = 0;
+                for (auto& w : workers) {
+                    forwarded += w->forwarded;
+                    held += w->held_total;
+                }
+                std::ostringstream line;
+                line << "forwarded=" << forwarded << " queued=" << queued << " stalls=" << stalls;
+                if (credits) line << " held=" << held;
+                FMF_LOG_INFO("[server_forward] " << line.str());
+                ctl.publish(STATS_CHANNEL, "server_forward." + consumer + " " + line.str(), nullptr);
+                ctl.commit();
+                last_stats = now;
+            }
+        } catch (const cpp_redis::redis_error &e) {
+            FMF_LOG_ERROR("[server_forward] Control publish failed: " << e.what());
+        }
+    }
+
+    if (streams) {
+        stream_reader.join();
+        reader.disconnect();
+    } else {
+        sub.unsubscribe("locations_mid");
+        sub.disconnect();
+    }
+    for (auto& w : workers) {
+        w->thread.join();
+        w->pub.disconnect();
+    }
+    if (credits) {
+        grants.punsubscribe(CREDITS_RECEIVER_PATTERN);
+        grants.disconnect();
+    }
+    ctl.disconnect();
+    FMF_LOG_INFO("[server_forward] Shutting down.");
     return 0;
 }
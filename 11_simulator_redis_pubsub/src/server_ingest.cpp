@@ -4,62 +4,189 @@
 #include <chrono>
 #include <csignal>
 #include <atomic>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+#include <getopt.h>
+#include "coalesce.h"
+#include "credits.h"
+#include "delta.h"
+#include "log.h"
+#include "reconnect.h"
+#include "shard.h"
+#include "streams.h"
+#include "trace.h"
 
 std::atomic<bool> running{true};
 
+// Bytes and updates as they arrived on locations_raw.<shard>
+std::atomic<uint64_t> wire_bytes{0}, wire_updates{0}, delta_dropped{0};
+
+// How often the coalescing buffer is flushed downstream
+static const int FLUSH_MS = 10;
+// How often counters are printed
+static const int STATS_SECONDS = 5;
+// Updates per pipelined commit when flushing
+static const size_t FLUSH_BATCH = 1000;
+
 void signal_handler(int) {
     running = false;
 }
 
-int main() {
-    std::cout << "[server_ingest] Starting up..." << std::endl;
-    std::cout.flush();
+//
+// Flush loop: every FLUSH_MS, take the latest update per client out of the
+// buffer and send them downstream in pipelined batches: PUBLISH to the
+// locations_mid channel, or XADD to the locations_mid stream. While the
+// publisher is reconnecting the buffer just keeps coalescing. With
+// credits (gate set), only as many updates leave as server_forward has
+// granted; the rest keep coalescing too.
+//
+static void flush_loop(CoalescingBuffer& buffer, ReconnectingClient& pub, bool streams, int worker,
+                       CreditGate* gate) {
+    const char* dest = streams ? STREAM_MID : "locations_mid";
+    std::vector<std::pair<int, std::string>> batch;
+    auto last_stats = std::chrono::steady_clock::now();
+    auto send = [&](cpp_redis::client& c, const std::string& msg, const cpp_redis::reply_callback_t& done) {
+        if (streams) c.send(xadd_cmd(STREAM_MID, msg), done);
+        else c.publish("locations_mid", msg, done);
+    };
 
-    signal(SIGINT, signal_handler);
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(FLUSH_MS));
+
+        size_t limit = SIZE_MAX;
+        if (gate) limit = static_cast<size_t>(gate->take(static_cast<int64_t>(buffer.size())));
+        size_t sent = limit ? drain_pending(pub, buffer, batch, FLUSH_BATCH, send, limit) : 0;
+        if (gate) gate->refund(static_cast<int64_t>(limit - sent));
+        if (sent) {
+            FMF_LOG_INFO_SAMPLED("[server_ingest] Forwarded " << sent << " updates to " << dest);
+        }
 
-    cpp_redis::client pub;
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_stats >= std::chrono::seconds(STATS_SECONDS)) {
+            CoalescingBuffer::Stats st = buffer.stats();
+            uint64_t updates = wire_updates;
+            std::ostringstream line;
+            line << "pending=" << buffer.size()
+                 << " bytes/update=" << (updates ? double(wire_bytes) / updates : 0.0)
+                 << " delta_dropped=" << delta_dropped
+                 << " received=" << st.received << " forwarded=" << st.flushed
+                 << " coalesced=" << st.coalesced << " dropped=" << st.dropped;
+            if (gate) line << " credits=" << gate->available() << " starved=" << gate->starved();
+            FMF_LOG_INFO("[server_ingest] " << line.str());
+            try_publish(pub, STATS_CHANNEL, "server_ingest." + std::to_string(worker) + " " + line.str());
+            last_stats = now;
+        }
+    }
+}
 
-    // Connect publisher (retry until successful)
-    while (running) {
-        try {
-            pub.connect("127.0.0.1", 6379);
-            std::cout << "[server_ingest] Publisher connected to Redis." << std::endl;
-            std::cout.flush();
-            break;
-        } catch (const cpp_redis::redis_error &e) {
-            std::cerr << "[server_ingest] Publisher connection failed: " << e.what() << ", retrying..." << std::endl;
-            std::cerr.flush();
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+int main(int argc, char** argv) {
+    bool trace = false, streams = false, credits = false;
+    int worker = 0, workers = 1;
+
+    static struct option long_options[] = {
+        {"trace",     no_argument,       0, 't'},
+        {"transport", required_argument, 0, 'T'},
+        {"worker",  required_argument, 0, 'w'},
+        {"workers", required_argument, 0, 'n'},
+        {"credits", no_argument,       0, 'c'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    int option_index = 0;
+    while ((opt = getopt_long(argc, argv, "tT:w:n:c", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 't': trace = true; break;   // stamp each message with the time it reached this hop
+            case 'T': streams = std::string(optarg) == "streams"; break;   // pubsub (default) | streams
+            case 'w': worker = std::atoi(optarg); break;
+            case 'n': workers = std::atoi(optarg); break;
+            case 'c': credits = true; break;   // send only what server_forward grants
+            default:
+                std::cerr << "Usage: " << argv[0] << " [--trace] [--transport pubsub|streams] [--worker I --workers N] [--credits]" << std::endl;
+                return 1;
         }
     }
+    if (workers < 1 || worker < 0 || worker >= workers) {
+        std::cerr << "--worker must be in [0, --workers)" << std::endl;
+        return 1;
+    }
+
+    // This worker's share of locations_raw.<shard>. When the worker count
+    // changes, stop the old set before starting the new one so that no
+    // shard is read by two workers at once (that could reorder a client).
+    std::vector<int> shards = owned_shards(worker, workers);
+
+    FMF_LOG_INFO("[server_ingest] Starting up as worker " << worker << "/" << workers
+              << ", owning " << shards.size() << " of " << NUM_SHARDS << " shards...");
+
+    signal(SIGINT, signal_handler);
+
+    // Publisher connects in the background
+    ReconnectingClient pub("server_ingest publisher");
+    pub.start();
+
+    // Updates wait here (latest per client) until the next flush
+    CoalescingBuffer buffer;
+    CreditGate gate;
+    std::thread flusher(flush_loop, std::ref(buffer), std::ref(pub), streams, worker, credits ? &gate : nullptr);
 
-    // Main loop: reconnect + resubscribe if subscriber disconnects
+    // Main loop: reconnect + resubscribe if subscriber disconnects,
+    // backing off with jitter between attempts
+    Backoff backoff;
     while (running) {
         try {
             cpp_redis::subscriber sub;
             sub.connect("127.0.0.1", 6379);
 
-            std::cout << "[server_ingest] Subscriber connected. Subscribing to locations_raw..." << std::endl;
-            std::cout.flush();
-
-            sub.subscribe("locations_raw", [&](const std::string&, const std::string& msg){
-                std::cout << "[server_ingest] Received: " << msg << std::endl;
-                std::cout.flush();
-
-                try {
-                    pub.publish("locations_mid", msg);
-                    pub.commit();
-                    std::cout << "[server_ingest] Forwarded to locations_mid: " << msg << std::endl;
-                    std::cout.flush();
-                } catch (const cpp_redis::redis_error &e) {
-                    std::cerr << "[server_ingest] Publish failed: " << e.what() << std::endl;
-                    std::cerr.flush();
+            FMF_LOG_INFO("[server_ingest] Subscriber connected. Subscribing to locations_raw.<shard>...");
+
+            // Delta state is per connection: after a reconnect every client
+            // resyncs on its next keyframe
+            DeltaDecoder decoder;
+
+            auto on_message = [&](const std::string&, const std::string& msg){
+                FMF_LOG_DEBUG("[server_ingest] Received: " << msg);
+                wire_bytes += msg.size();
+                ++wire_updates;
+
+                // Delta frames are turned back into "id,lat,lon,t_send"
+                std::string update;
+                if (is_delta_frame(msg)) {
+                    int id;
+                    double lat, lon;
+                    int64_t t_send;
+                    if (decoder.decode(msg, id, lat, lon, t_send) != DeltaDecoder::OK) {
+                        ++delta_dropped;
+                        return;
+                    }
+                    char buf[96];
+                    int len = std::snprintf(buf, sizeof(buf), "%d,%.6f,%.6f,%lld", id, lat, lon,
+                                            static_cast<long long>(t_send));
+                    update.assign(buf, len);
+                } else {
+                    update = msg;
                 }
-            });
+
+                // "id,lat,lon,...": keep only the newest update per id
+                if (trace) append_hop(update);
+                int id = std::atoi(update.c_str());
+                buffer.put(id, std::move(update));
+            };
+            for (int shard : shards) sub.subscribe(shard_channel(shard), on_message);
+
+            // server_forward's grants are shared by all ingest workers
+            if (credits) {
+                sub.subscribe(CREDITS_FORWARD, [&](const std::string&, const std::string& msg) {
+                    int64_t n, window;
+                    if (parse_grant(msg, n, window))
+                        gate.grant((n + workers - 1) / workers, (window + workers - 1) / workers);
+                });
+            }
 
             sub.commit();
-            std::cout << "[server_ingest] Ready, waiting for messages..." << std::endl;
-            std::cout.flush();
+            backoff.reset();
+            FMF_LOG_INFO("[server_ingest] Ready, waiting for messages...");
 
             // Keep running until disconnected or Ctrl-C
             while (running && sub.is_connected()) {
@@ -68,19 +195,19 @@ int main() {
 
             if (!running) break;
 
-            std::cerr << "[server_ingest] Subscriber disconnected. Reconnecting in 1s..." << std::endl;
-            std::cerr.flush();
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+            auto wait = backoff.next();
+            FMF_LOG_WARN("[server_ingest] Subscriber disconnected. Reconnecting in " << wait.count() << "ms...");
+            std::this_thread::sleep_for(wait);
 
         } catch (const cpp_redis::redis_error &e) {
-            std::cerr << "[server_ingest] Redis error: " << e.what() << ", retrying in 1s..." << std::endl;
-            std::cerr.flush();
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+            auto wait = backoff.next();
+            FMF_LOG_ERROR("[server_ingest] Redis error: " << e.what() << ", retrying in " << wait.count() << "ms...");
+            std::this_thread::sleep_for(wait);
         }
     }
 
-    pub.disconnect();
-    std::cout << "[server_ingest] Shutting down." << std::endl;
-    std::cout.flush();
+    flusher.join();
+    pub.stop();
+    FMF_LOG_INFO("[server_ingest] Shutting down.");
     return 0;
 }
@@ -0,0 +1,61 @@
+#ifndef FMF_SHARD_H
+#define FMF_SHARD_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// Partitioning of the raw location stream.
+//
+// A client always publishes to the same shard, locations_raw.<shard>, so
+// updates from one client stay in order on a single channel. The number
+// of shards is fixed; what changes when ingest scales out is which
+// worker owns which shard. That mapping uses jump consistent hashing
+// (Lamping & Veach), so going from N to N+1 workers moves only ~1/(N+1)
+// of the shards and every other shard stays where it was.
+//
+
+static const int NUM_SHARDS = 256;
+
+// splitmix64 finalizer: client ids are small sequential ints, spread them out
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Jump consistent hash: bucket in [0, num_buckets) for `key`
+inline int jump_consistent_hash(uint64_t key, int num_buckets) {
+    int64_t b = -1, j = 0;
+    while (j < num_buckets) {
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = static_cast<int64_t>((b + 1) * (double(1LL << 31) / double((key >> 33) + 1)));
+    }
+    return static_cast<int>(b);
+}
+
+inline int shard_of(int client_id) {
+    return static_cast<int>(mix64(static_cast<uint64_t>(client_id)) % NUM_SHARDS);
+}
+
+inline std::string shard_channel(int shard) {
+    return "locations_raw." + std::to_string(shard);
+}
+
+// Ingest worker that owns `shard` when there are `num_workers` of them
+inline int shard_owner(int shard, int num_workers) {
+    return jump_consistent_hash(mix64(static_cast<uint64_t>(shard)), num_workers);
+}
+
+// Shards owned by `worker` out of `num_workers`
+inline std::vector<int> owned_shards(int worker, int num_workers) {
+    std::vector<int> shards;
+    for (int s = 0; s < NUM_SHARDS; ++s)
+        if (shard_owner(s, num_workers) == worker) shards.push_back(s);
+    return shards;
+}
+
+#endif // FMF_SHARD_H
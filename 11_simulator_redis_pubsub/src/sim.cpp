@@ -0,0 +1,409 @@
+////
+//// Discrete-event simulation of the whole pipeline on virtual time:
+//// clients -> server_ingest -> server_forward -> receivers, in one
+//// process, without Redis
+////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include "friends.h"
+#include "netmodel.h"
+#include "shard.h"
+#include "timer_wheel.h"
+#include "trace.h"
+
+//
+// Virtual time is in microseconds; the event wheel ticks every TICK_US.
+// Events due within the same tick run in wheel order, the stages still
+// compute with exact timestamps.
+//
+// What is modelled, per stage:
+//   clients   one update every --interval-ms, phases spread over one interval
+//   links     latency + loss models (netmodel.h) on each of the three hops
+//   ingest    a subscriber thread per worker (--ingest-us per message) that
+//             coalesces into a per-client buffer, flushed every --flush-ms by
+//             a publisher (--publish-us per message); clients map to workers
+//             through the same shards as server_ingest
+//   forward   --forward-workers ordered workers (--forward-us per message,
+//             plus --publish-us per channel published to)
+//   receivers sinks: a broadcast channel with --receivers subscribers, or
+//             per-user channels when a friends file is given
+//
+// A batch published by one ingest flush shares one link latency sample
+// (it is one pipelined write), its messages are lost independently.
+//
+static const int64_t TICK_US = 100;
+
+struct Options {
+    int clients = 1000000;
+    int64_t duration_s = 3600;
+    int interval_ms = 5000;
+    int ingest_workers = 1;
+    int forward_workers = 4;
+    int flush_ms = 10;
+    int receivers = 1;
+    std::string friends;
+    std::string latency = "lognormal:300:0.5";
+    std::string loss = "none";
+    double ingest_us = 2;
+    double forward_us = 2;
+    double publish_us = 1;
+    uint64_t seed = 1;
+};
+
+enum EventKind : uint32_t { ARRIVE_INGEST, ARRIVE_FORWARD };
+
+struct Event {
+    uint32_t kind;
+    uint32_t id;      // client index, or batch index for ARRIVE_FORWARD
+    int64_t t_send;
+    int64_t t_arrive;
+};
+
+struct Pending {
+    uint32_t client;    // index into the calendar
+    int64_t t_send;
+    int64_t t_ingest;   // arrival at ingest
+    int64_t t_ready;    // when the subscriber thread is done with it
+};
+
+struct Message {
+    uint32_t client;
+    int64_t t_send;
+    int64_t t_ingest;
+    int64_t t_forward;  // arrival at forward
+};
+
+struct IngestWorker {
+    double busy_until = 0;    // subscriber thread
+    double flush_until = 0;   // publisher thread
+    double busy_us = 0;
+    std::vector<Pending> pending;
+    std::vector<Pending> later;
+    uint64_t received = 0;
+    uint64_t coalesced = 0;
+};
+
+struct ForwardWorker {
+    double busy_until = 0;
+    double busy_us = 0;
+    uint64_t forwarded = 0;
+};
+
+class Simulation {
+public:
+    explicit Simulation(const Options& o)
+        : opt_(o), rng_(o.seed),
+          to_ingest_(o.latency, o.loss), to_forward_(o.latency, o.loss), to_receiver_(o.latency, o.loss),
+          ingest_(o.ingest_workers), forward_(o.forward_workers),
+          owner_(o.clients), slot_(o.clients, -1) {
+        if (!o.friends.empty() && !friends_.load(o.friends))
+            throw std::runtime_error("cannot read friends file " + o.friends);
+
+        // Clients fire on a fixed period, so instead of one wheel timer
+        // each they sit in a calendar with one bucket per tick of the
+        // interval (counting sort by phase). Per-client state is indexed
+        // by calendar position, so a bucket's clients are adjacent in
+        // memory; ids_ maps back to the client id.
+        period_ticks_ = std::max<int64_t>(1, o.interval_ms * 1000LL / TICK_US);
+        std::vector<uint32_t> phase(o.clients);
+        calendar_offsets_.assign(period_ticks_ + 1, 0);
+        for (int c = 0; c < o.clients; ++c) {
+            phase[c] = static_cast<uint32_t>(rng_.below(period_ticks_));
+            ++calendar_offsets_[phase[c] + 1];
+        }
+        for (int64_t b = 0; b < period_ticks_; ++b) calendar_offsets_[b + 1] += calendar_offsets_[b];
+        ids_.resize(o.clients);
+        std::vector<uint32_t> fill(calendar_offsets_.begin(), calendar_offsets_.end() - 1);
+        for (int c = 0; c < o.clients; ++c) ids_[fill[phase[c]]++] = c;
+
+        for (int i = 0; i < o.clients; ++i)
+            owner_[i] = static_cast<uint16_t>(shard_owner(shard_of(ids_[i]), o.ingest_workers));
+    }
+
+    void run() {
+        int64_t end_tick = opt_.duration_s * 1000000 / TICK_US;
+        int64_t flush_ticks = std::max<int64_t>(1, opt_.flush_ms * 1000LL / TICK_US);
+        auto fire = [this](const Event& e) { ++events_; handle(e); };
+
+        auto start = std::chrono::steady_clock::now();
+        for (int64_t tick = 1; tick <= end_tick; ++tick) {
+            wheel_.advance_to(tick, fire);
+            send_bucket(tick);
+            if (tick % flush_ticks == 0) flush_all(tick * TICK_US);
+        }
+        // Stop the clients and let everything in flight drain
+        int64_t tick = end_tick;
+        while (wheel_.size() > 0 || pending_total() > 0) {
+            ++tick;
+            wheel_.advance_to(tick, fire);
+            if (tick % flush_ticks == 0) flush_all(tick * TICK_US);
+        }
+        wall_s_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        drained_s_ = static_cast<double>(tick - end_tick) * TICK_US / 1e6;
+    }
+
+    void report(std::ostream& os) const {
+        double sim_s = static_cast<double>(opt_.duration_s);
+        os << "[sim] " << opt_.clients << " clients, " << opt_.duration_s << " s simulated (+"
+           << drained_s_ << " s drain), seed " << opt_.seed << "\n";
+        os << "[sim] latency " << opt_.latency << ", loss " << opt_.loss << "\n";
+
+        uint64_t received = 0, coalesced = 0;
+        double ingest_busy = 0, forward_busy = 0;
+        for (auto& w : ingest_) {
+            received += w.received;
+            coalesced += w.coalesced;
+            ingest_busy += w.busy_us;
+        }
+        uint64_t forwarded = 0;
+        for (auto& w : forward_) {
+            forwarded += w.forwarded;
+            forward_busy += w.busy_us;
+        }
+        os << "  sent=" << sent_ << " ingested=" << received << " coalesced=" << coalesced
+           << " forwarded=" << forwarded << " delivered=" << delivered_ << "\n";
+        os << "  lost: client->ingest=" << to_ingest_.dropped << " ingest->forward=" << to_forward_.dropped
+           << " forward->receiver=" << to_receiver_.dropped << "\n";
+        double span_us = (sim_s + drained_s_) * 1e6;
+        os << "  utilization: ingest=" << 100 * ingest_busy / (span_us * ingest_.size())
+           << "% forward=" << 100 * forward_busy / (span_us * forward_.size()) << "%\n";
+
+        os << "[sim] latency:\n";
+        e2e_.print(os, "end-to-end");
+        hops_[0].print(os, "client->ingest");
+        hops_[1].print(os, "ingest->forward");
+        hops_[2].print(os, "forward->receiver");
+
+        os << "[sim] " << events_ << " events in " << wall_s_ << " s = "
+           << static_cast<uint64_t>(events_ / wall_s_) << " events/s, "
+           << static_cast<uint64_t>(sim_s / wall_s_) << "x real time" << std::endl;
+    }
+
+private:
+    // Every client in this tick's calendar bucket sends one update
+    void send_bucket(int64_t tick) {
+        int64_t bucket = tick % period_ticks_;
+        int64_t now = tick * TICK_US;
+        for (uint32_t i = calendar_offsets_[bucket]; i < calendar_offsets_[bucket + 1]; ++i) {
+            ++sent_;
+            ++events_;
+            int64_t delay = to_ingest_.transmit(rng_);
+            if (delay < 0) continue;
+            schedule(Event{ARRIVE_INGEST, i, now, now + delay});
+        }
+    }
+
+    void schedule(const Event& e) {
+        int64_t due = (e.t_arrive + TICK_US - 1) / TICK_US;
+        wheel_.schedule(static_cast<uint64_t>(std::max<int64_t>(1, due - static_cast<int64_t>(wheel_.now()))), e);
+    }
+
+    void handle(const Event& e) {
+        if (e.kind == ARRIVE_INGEST) {
+            IngestWorker& w = ingest_[owner_[e.id]];
+            ++w.received;
+            double ready = std::max<double>(e.t_arrive, w.busy_until) + opt_.ingest_us;
+            w.busy_until = ready;
+            w.busy_us += opt_.ingest_us;
+            // Latest update per client wins, like CoalescingBuffer
+            int32_t& slot = slot_[e.id];
+            Pending p{e.id, e.t_send, e.t_arrive, static_cast<int64_t>(ready)};
+            if (slot >= 0) {
+                w.pending[slot] = p;
+                ++w.coalesced;
+            } else {
+                slot = static_cast<int32_t>(w.pending.size());
+                w.pending.push_back(p);
+            }
+        } else {
+            forward_batch(e.id);
+        }
+    }
+
+    size_t pending_total() const {
+        size_t n = 0;
+        for (auto& w : ingest_) n += w.pending.size();
+        return n;
+    }
+
+    // Ingest flush at virtual time `now`: publish what the subscriber
+    // threads have finished with, as one batch per worker
+    void flush_all(int64_t now) {
+        for (auto& w : ingest_) {
+            if (w.pending.empty()) continue;
+            uint32_t b = alloc_batch();
+            std::vector<Message>& batch = batches_[b];
+            w.later.clear();
+            double t = std::max<double>(now, w.flush_until);
+            int64_t delay = to_forward_.latency.sample(rng_);
+            for (auto& p : w.pending) {
+                if (p.t_ready > now) {
+                    slot_[p.client] = static_cast<int32_t>(w.later.size());
+                    w.later.push_back(p);
+                    continue;
+                }
+                slot_[p.client] = -1;
+                t += opt_.publish_us;
+                w.busy_us += opt_.publish_us;
+                ++to_forward_.sent;
+                if (to_forward_.loss.lost(rng_)) {
+                    ++to_forward_.dropped;
+                    continue;
+                }
+                batch.push_back(Message{p.client, p.t_send, p.t_ingest, static_cast<int64_t>(t) + delay});
+            }
+            w.flush_until = t;
+            w.pending.swap(w.later);
+            if (batch.empty()) {
+                free_batches_.push_back(b);
+                continue;
+            }
+            schedule(Event{ARRIVE_FORWARD, b, 0, batch.front().t_forward});
+        }
+    }
+
+    void forward_batch(uint32_t b) {
+        std::vector<Message>& batch = batches_[b];
+        int num_workers = static_cast<int>(forward_.size());
+        bool per_user = friends_.num_users() > 0;
+        for (auto& m : batch) {
+            // Same client -> same worker, as in server_forward
+            int id = static_cast<int>(ids_[m.client]);
+            ForwardWorker& w = forward_[mix64(id) % num_workers];
+            uint32_t fanout = per_user ? (friends_.has_user(id) ? friends_.degree(id) : 0)
+                                       : static_cast<uint32_t>(opt_.receivers);
+            uint32_t publishes = per_user ? fanout : 1;
+            double cost = opt_.forward_us + publishes * opt_.publish_us;
+            double done = std::max<double>(m.t_forward, w.busy_until) + cost;
+            w.busy_until = done;
+            w.busy_us += cost;
+            ++w.forwarded;
+
+            hops_[0].record(m.t_ingest - m.t_send);
+            hops_[1].record(m.t_forward - m.t_ingest);
+            // Receivers only record, so deliveries need no events
+            for (uint32_t r = 0; r < fanout; ++r) {
+                int64_t delay = to_receiver_.transmit(rng_);
+                if (delay < 0) continue;
+                int64_t arrived = static_cast<int64_t>(done) + delay;
+                ++delivered_;
+                hops_[2].record(arrived - m.t_forward);
+                e2e_.record(arrived - m.t_send);
+            }
+        }
+        batch.clear();
+        free_batches_.push_back(b);
+    }
+
+    uint32_t alloc_batch() {
+        if (!free_batches_.empty()) {
+            uint32_t b = free_batches_.back();
+            free_batches_.pop_back();
+            return b;
+        }
+        batches_.emplace_back();
+        return static_cast<uint32_t>(batches_.size() - 1);
+    }
+
+    Options opt_;
+    Rng rng_;
+    Link to_ingest_, to_forward_, to_receiver_;
+    FriendGraph friends_;
+    TimerWheel<Event> wheel_;
+
+    std::vector<IngestWorker> ingest_;
+    std::vector<ForwardWorker> forward_;
+    std::vector<uint16_t> owner_;    // client index -> ingest worker
+    std::vector<int32_t> slot_;      // client index -> position in its worker's pending, or -1
+
+    int64_t period_ticks_ = 1;
+    std::vector<uint32_t> calendar_offsets_;
+    std::vector<uint32_t> ids_;      // client index -> client id
+
+    std::vector<std::vector<Message>> batches_;
+    std::vector<uint32_t> free_batches_;
+
+    LatencyHistogram e2e_;
+    LatencyHistogram hops_[3];
+    uint64_t sent_ = 0;
+    uint64_t delivered_ = 0;
+    uint64_t events_ = 0;
+    double wall_s_ = 0;
+    double drained_s_ = 0;
+};
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--clients N] [--duration S] [--interval-ms MS] [--seed N]\n"
+              << "           [--ingest-workers N] [--forward-workers N] [--flush-ms MS]\n"
+              << "           [--ingest-us US] [--forward-us US] [--publish-us US]\n"
+              << "           [--latency const:US|uniform:MIN:MAX|lognormal:MEDIAN:SIGMA]\n"
+              << "           [--loss none|bernoulli:P|ge:P_GB:P_BG:LOSS_BAD]\n"
+              << "           [--receivers N | --friends friends.csv]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    Options o;
+
+    static struct option long_options[] = {
+        {"clients",         required_argument, 0, 'n'},
+        {"duration",        required_argument, 0, 'd'},
+        {"interval-ms",     required_argument, 0, 'i'},
+        {"seed",            required_argument, 0, 's'},
+        {"ingest-workers",  required_argument, 0, 'I'},
+        {"forward-workers", required_argument, 0, 'F'},
+        {"flush-ms",        required_argument, 0, 'f'},
+        {"ingest-us",       required_argument, 0, 'a'},
+        {"forward-us",      required_argument, 0, 'b'},
+        {"publish-us",      required_argument, 0, 'p'},
+        {"latency",         required_argument, 0, 'l'},
+        {"loss",            required_argument, 0, 'L'},
+        {"receivers",       required_argument, 0, 'r'},
+        {"friends",         required_argument, 0, 'g'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    int option_index = 0;
+    while ((opt = getopt_long(argc, argv, "n:d:i:s:I:F:f:a:b:p:l:L:r:g:", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'n': o.clients = std::atoi(optarg); break;
+            case 'd': o.duration_s = std::atoll(optarg); break;
+            case 'i': o.interval_ms = std::atoi(optarg); break;
+            case 's': o.seed = std::strtoull(optarg, nullptr, 10); break;
+            case 'I': o.ingest_workers = std::atoi(optarg); break;
+            case 'F': o.forward_workers = std::atoi(optarg); break;
+            case 'f': o.flush_ms = std::atoi(optarg); break;
+            case 'a': o.ingest_us = std::atof(optarg); break;
+            case 'b': o.forward_us = std::atof(optarg); break;
+            case 'p': o.publish_us = std::atof(optarg); break;
+            case 'l': o.latency = optarg; break;
+            case 'L': o.loss = optarg; break;
+            case 'r': o.receivers = std::atoi(optarg); break;
+            case 'g': o.friends = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind != argc || o.clients <= 0 || o.duration_s <= 0 || o.interval_ms <= 0 || o.flush_ms <= 0 ||
+        o.ingest_workers <= 0 || o.ingest_workers > 65535 || o.forward_workers <= 0 || o.receivers < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        Simulation sim(o);
+        sim.run();
+        sim.report(std::cout);
+    } catch (const std::exception& e) {
+        std::cerr << "[sim] " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
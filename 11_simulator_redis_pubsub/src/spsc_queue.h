@@ -0,0 +1,69 @@
+#ifndef FMF_SPSC_QUEUE_H
+#define FMF_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+//
+// Bounded lock-free single-producer / single-consumer ring buffer.
+//
+// Exactly one thread may call try_push() and exactly one (other) thread
+// may call try_pop(). Capacity is rounded up to a power of two. Head and
+// tail live on separate cache lines, and each side caches the other
+// side's index so the shared atomics are only re-read when the ring looks
+// full (producer) or empty (consumer).
+//
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) {
+        size_t cap = 2;
+        while (cap < capacity) cap <<= 1;
+        slots_.resize(cap);
+        mask_ = cap - 1;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // Producer side. Returns false (and leaves `value` alone) when full.
+    bool try_push(T&& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ > mask_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ > mask_) return false;
+        }
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false when empty.
+    bool try_pop(T& out) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) return false;
+        }
+        out = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate number of queued items (exact only when both sides are idle)
+    size_t size_approx() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> slots_;
+    size_t mask_ = 0;
+
+    alignas(64) std::atomic<size_t> head_{0};   // written by consumer
+    size_t tail_cache_ = 0;                     // consumer's view of tail_
+    alignas(64) std::atomic<size_t> tail_{0};   // written by producer
+    size_t head_cache_ = 0;                     // producer's view of head_
+};
+
+#endif // FMF_SPSC_QUEUE_H
@@ -0,0 +1,110 @@
+#ifndef FMF_STREAMS_H
+#define FMF_STREAMS_H
+
+#include <cpp_redis/cpp_redis>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+//
+// Redis Streams transport between server_ingest and server_forward.
+//
+// Unlike pub/sub, a stream keeps entries until they are trimmed, so a slow
+// or restarting consumer picks up where it left off, and a consumer group
+// lets several forwarders split one stream. Ingest appends with XADD
+// (approximate MAXLEN trimming); forwarders read with XREADGROUP in
+// batches and acknowledge with one XACK per batch.
+//
+
+static const char* const STREAM_MID = "locations_mid.stream";
+static const char* const FORWARD_GROUP = "forwarders";
+static const char* const STREAM_FIELD = "m";
+static const long STREAM_MAXLEN = 1000000;
+
+struct StreamEntry {
+    std::string id;
+    std::string msg;
+    bool trimmed = false;   // pending entry MAXLEN already removed: only ack it
+};
+
+// Default consumer name, the same every time `role` runs on this host, so
+// a restarted consumer finds the entries it had not acknowledged. Give
+// each of several consumers on one host its own name.
+inline std::string stable_consumer(const std::string& role) {
+    char host[256] = "localhost";
+    ::gethostname(host, sizeof(host) - 1);
+    return role + "-" + host;
+}
+
+inline std::vector<std::string> xadd_cmd(const std::string& key, const std::string& msg) {
+    return {"XADD", key, "MAXLEN", "~", std::to_string(STREAM_MAXLEN), "*", STREAM_FIELD, msg};
+}
+
+inline std::vector<std::string> xack_cmd(const std::string& key, const std::string& group,
+                                         const std::vector<std::string>& ids) {
+    std::vector<std::string> cmd{"XACK", key, group};
+    cmd.insert(cmd.end(), ids.begin(), ids.end());
+    return cmd;
+}
+
+// Create the consumer group (and the stream) if needed. An existing group
+// is not an error.
+inline void ensure_group(cpp_redis::client& c, const std::string& key, const std::string& group) {
+    auto f = c.send({"XGROUP", "CREATE", key, group, "$", "MKSTREAM"});
+    c.sync_commit();
+    cpp_redis::reply r = f.get();
+    if (r.is_error() && r.as_string().find("BUSYGROUP") == std::string::npos)
+        throw cpp_redis::redis_error(r.as_string());
+}
+
+//
+// Read up to `count` entries for `consumer`, blocking up to `block_ms`.
+// from_id is ">" for new entries, or an id to re-read this consumer's
+// delivered-but-unacknowledged entries after it ("0" for all of them,
+// after a restart). Such history reads never block.
+//
+inline void read_group(cpp_redis::client& c, const std::string& key, const std::string& group,
+                       const std::string& consumer, const std::string& from_id,
+                       int count, int block_ms, std::vector<StreamEntry>& out) {
+    out.clear();
+    auto f = c.send({"XREADGROUP", "GROUP", group, consumer,
+                     "COUNT", std::to_string(count), "BLOCK", std::to_string(block_ms),
+                     "STREAMS", key, from_id});
+    c.sync_commit();
+    cpp_redis::reply r = f.get();
+    if (r.is_error()) throw cpp_redis::redis_error(r.as_string());
+    if (!r.is_array()) return;   // null: timed out with nothing to read
+
+    // [[key, [[id, [field, value, ...]], ...]]]
+    for (const auto& stream : r.as_array()) {
+        if (!stream.is_array() || stream.as_array().size() < 2) continue;
+        for (const auto& entry : stream.as_array()[1].as_array()) {
+            const auto& parts = entry.as_array();
+            if (parts.size() < 2) continue;
+            StreamEntry e;
+            e.id = parts[0].as_string();
+            e.trimmed = true;
+            if (parts[1].is_array()) {
+                const auto& fields = parts[1].as_array();
+                for (size_t i = 0; i + 1 < fields.size(); i += 2) {
+                    if (fields[i].as_string() == STREAM_FIELD) {
+                        e.msg = fields[i + 1].as_string();
+                        e.trimmed = false;
+                    }
+                }
+            }
+            out.push_back(std::move(e));
+        }
+    }
+}
+
+// Where the next read_group starts: replaying pending entries moves past
+// the last one returned (their acks may not have landed yet), and an
+// empty replay means they are all done, so switch to new entries
+inline void advance_cursor(std::string& from_id, const std::vector<StreamEntry>& entries) {
+    if (from_id == ">") return;
+    from_id = entries.empty() ? ">" : entries.back().id;
+}
+
+#endif // FMF_STREAMS_H
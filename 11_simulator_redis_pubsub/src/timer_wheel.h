@@ -0,0 +1,126 @@
+#ifndef FMF_TIMER_WHEEL_H
+#define FMF_TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//
+// Hierarchical timer wheel (4 levels x 256 slots, like the classic Linux
+// kernel timer wheel). schedule() and each fired timer are O(1); timers
+// further out sit in coarser levels and cascade down as time advances.
+// Ticks are whatever unit the caller uses (the load generator uses 1 ms).
+//
+// Timer nodes live in a pool with a free list, so scheduling in steady
+// state does not allocate.
+//
+template <typename T>
+class TimerWheel {
+public:
+    static const int LEVELS = 4;
+    static const int BITS = 8;
+    static const uint32_t SLOTS = 1u << BITS;
+    static const uint32_t MASK = SLOTS - 1;
+
+    TimerWheel() {
+        for (auto& level : heads_)
+            for (auto& h : level) h = NIL;
+    }
+
+    uint64_t now() const { return now_; }
+    size_t size() const { return size_; }
+
+    // Fire `value` after `delay` ticks (at least one)
+    void schedule(uint64_t delay, const T& value) {
+        if (delay == 0) delay = 1;
+        uint32_t n = alloc();
+        nodes_[n].value = value;
+        nodes_[n].expires = now_ + delay;
+        place(n);
+        ++size_;
+    }
+
+    // Advance to absolute tick `target`, calling fire(value) for every
+    // timer that expires on the way. fire() may schedule new timers.
+    template <typename F>
+    void advance_to(uint64_t target, F&& fire) {
+        while (now_ < target) {
+            ++now_;
+            uint32_t idx = now_ & MASK;
+            if (idx == 0) cascade(1);
+
+            uint32_t n = heads_[0][idx];
+            heads_[0][idx] = NIL;
+            while (n != NIL) {
+                uint32_t next = nodes_[n].next;
+                T value = nodes_[n].value;
+                release(n);
+                --size_;
+                fire(value);
+                n = next;
+            }
+        }
+    }
+
+private:
+    static const uint32_t NIL = 0xffffffffu;
+
+    struct Node {
+        T value;
+        uint64_t expires;
+        uint32_t next;
+    };
+
+    void place(uint32_t n) {
+        uint64_t expires = nodes_[n].expires;
+        uint64_t diff = expires > now_ ? expires - now_ : 0;
+        int level = 0;
+        while (level < LEVELS - 1 && diff >= (uint64_t(1) << (BITS * (level + 1)))) ++level;
+        if (level == LEVELS - 1 && diff >= (uint64_t(1) << (BITS * LEVELS))) {
+            // Beyond the wheel's range: park in the farthest slot, it
+            // will be re-placed when that slot cascades
+            expires = now_ + (uint64_t(1) << (BITS * LEVELS)) - 1;
+        }
+        uint32_t slot = (expires >> (BITS * level)) & MASK;
+        nodes_[n].next = heads_[level][slot];
+        heads_[level][slot] = n;
+    }
+
+    // Re-place every timer in the current slot of `level` into lower levels
+    void cascade(int level) {
+        if (level >= LEVELS) return;
+        uint32_t idx = (now_ >> (BITS * level)) & MASK;
+        if (idx == 0) cascade(level + 1);
+
+        uint32_t n = heads_[level][idx];
+        heads_[level][idx] = NIL;
+        while (n != NIL) {
+            uint32_t next = nodes_[n].next;
+            place(n);
+            n = next;
+        }
+    }
+
+    uint32_t alloc() {
+        if (free_ != NIL) {
+            uint32_t n = free_;
+            free_ = nodes_[n].next;
+            return n;
+        }
+        nodes_.push_back(Node{});
+        return static_cast<uint32_t>(nodes_.size() - 1);
+    }
+
+    void release(uint32_t n) {
+        nodes_[n].next = free_;
+        free_ = n;
+    }
+
+    std::vector<Node> nodes_;
+    uint32_t heads_[LEVELS][SLOTS];
+    uint32_t free_ = NIL;
+    uint64_t now_ = 0;
+    size_t size_ = 0;
+};
+
+#endif // FMF_TIMER_WHEEL_H
@@ -0,0 +1,116 @@
+#ifndef FMF_TRACE_H
+#define FMF_TRACE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//
+// Latency tracing across the pub/sub hops.
+//
+// A traced message is "id,lat,lon,t_send[,t_hop1[,t_hop2...]]": the client
+// appends its send time and every traced server appends the time it
+// received the message. Times are wall-clock microseconds so stamps taken
+// in different processes can be compared.
+//
+
+inline int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Append this hop's receive time
+inline void append_hop(std::string& msg) {
+    msg += ',';
+    msg += std::to_string(now_us());
+}
+
+// Parse the timestamps that follow "id,lat,lon". Returns how many were found.
+inline int parse_trace(const std::string& msg, int64_t* stamps, int max_stamps) {
+    const char* p = msg.c_str();
+    for (int commas = 0; commas < 3; ++p) {
+        if (*p == '\0') return 0;
+        if (*p == ',') ++commas;
+    }
+    int n = 0;
+    while (n < max_stamps && *p) {
+        char* end;
+        stamps[n++] = std::strtoll(p, &end, 10);
+        if (*end != ',') break;
+        p = end + 1;
+    }
+    return n;
+}
+
+//
+// Log-linear latency histogram (HdrHistogram-style): values below 16 us
+// get their own bucket, above that every power of two is split into 16
+// sub-buckets, so relative error stays under ~6% at any magnitude.
+//
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB = 1 << SUB_BITS;
+
+    LatencyHistogram() : buckets_(SUB * (64 - SUB_BITS + 1), 0) {}
+
+    void record(int64_t us) {
+        uint64_t v = us < 0 ? 0 : static_cast<uint64_t>(us);
+        ++buckets_[index(v)];
+        ++count_;
+        sum_ += v;
+        max_ = std::max(max_, v);
+    }
+
+    uint64_t count() const { return count_; }
+
+    // Upper bound of the bucket holding the p-th percentile (0..100)
+    uint64_t percentile(double p) const {
+        if (count_ == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * (count_ - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets_.size(); ++i) {
+            seen += buckets_[i];
+            if (seen >= rank) return std::min(upper(i), max_);
+        }
+        return max_;
+    }
+
+    void print(std::ostream& os, const std::string& label) const {
+        os << "  " << label << ": n=" << count_;
+        if (count_) {
+            os << " mean=" << sum_ / count_ << "us"
+               << " p50=" << percentile(50) << "us"
+               << " p90=" << percentile(90) << "us"
+               << " p99=" << percentile(99) << "us"
+               << " max=" << max_ << "us";
+        }
+        os << "\n";
+    }
+
+private:
+    static size_t index(uint64_t v) {
+        if (v < SUB) return v;
+        int e = 63 - __builtin_clzll(v);                    // e >= SUB_BITS
+        uint64_t sub = (v >> (e - SUB_BITS)) & (SUB - 1);
+        return SUB * (e - SUB_BITS + 1) + sub;
+    }
+
+    static uint64_t upper(size_t i) {
+        if (i < SUB) return i;
+        int e = static_cast<int>(i / SUB) + SUB_BITS - 1;
+        uint64_t sub = i % SUB;
+        return ((SUB + sub + 1) << (e - SUB_BITS)) - 1;
+    }
+
+    std::vector<uint64_t> buckets_;
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+#endif // FMF_TRACE_H
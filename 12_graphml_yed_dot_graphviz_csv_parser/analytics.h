@@ -0,0 +1,325 @@
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "graph.h"
+#include "parallel.h"
+
+// Graph algorithms for csv2dot's subcommands, all over Graph's CSR
+// arrays (out(v) / in(v) are contiguous runs of ids, so every pass
+// below streams through memory rather than chasing pointers).
+//
+// BFS, degree counting and PageRank are split into fixed blocks of
+// nodes or frontier entries run with parallelFor(); each block writes
+// its own output and blocks are combined in block order, so results do
+// not depend on the number of threads. SCC (Tarjan) and topological
+// sort (Kahn) are inherently sequential and run on one thread in
+// linear time, with explicit stacks so deep graphs cannot overflow the
+// call stack.
+
+static const uint32_t UNREACHED = UINT32_MAX;
+static const size_t ANALYTICS_BLOCK = 4096;
+
+// Hops from `source` along out-edges to every node, UNREACHED if none.
+// Level-synchronous: each level's frontier is expanded in parallel and
+// a node joins the next frontier through whichever thread claims it
+// first; frontiers are sorted so the traversal order is reproducible.
+inline std::vector<uint32_t> bfsDistances(const Graph& g, uint32_t source) {
+    const size_t n = g.num_nodes();
+    std::unique_ptr<std::atomic<uint32_t>[]> dist(new std::atomic<uint32_t>[n]);
+    parallelFor((n + ANALYTICS_BLOCK - 1) / ANALYTICS_BLOCK, [&](size_t b) {
+        size_t end = std::min(n, (b + 1) * ANALYTICS_BLOCK);
+        for (size_t v = b * ANALYTICS_BLOCK; v < end; ++v) dist[v].store(UNREACHED, std::memory_order_relaxed);
+    });
+
+    std::vector<uint32_t> frontier{source};
+    dist[source].store(0, std::memory_order_relaxed);
+    for (uint32_t level = 1; !frontier.empty(); ++level) {
+        size_t blocks = (frontier.size() + ANALYTICS_BLOCK - 1) / ANALYTICS_BLOCK;
+        std::vector<std::vector<uint32_t>> found(blocks);
+        parallelFor(blocks, [&](size_t b) {
+            size_t end = std::min(frontier.size(), (b + 1) * ANALYTICS_BLOCK);
+            for (size_t i = b * ANALYTICS_BLOCK; i < end; ++i) {
+                for (uint32_t t : g.out(frontier[i])) {
+                    uint32_t unseen = UNREACHED;
+                    if (dist[t].load(std::memory_order_relaxed) == UNREACHED &&
+                        dist[t].compare_exchange_strong(unseen, level, std::memory_order_relaxed))
+                        found[b].push_back(t);
+                }
+            }
+        });
+        frontier.clear();
+        for (auto& f : found) frontier.insert(frontier.end(), f.begin(), f.end());
+        std::sort(frontier.begin(), frontier.end());
+    }
+
+    std::vector<uint32_t> out(n);
+    for (size_t v = 0; v < n; ++v) out[v] = dist[v].load(std::memory_order_relaxed);
+    return out;
+}
+
+// A shortest path from `from` to `to` (both included), empty if `to` is
+// unreachable. Walks back from `to` through the lowest-id predecessor
+// one hop closer, so the path is the same on every run.
+inline std::vector<uint32_t> shortestPath(const Graph& g, uint32_t from, uint32_t to) {
+    std::vector<uint32_t> dist = bfsDistances(g, from);
+    std::vector<uint32_t> path;
+    if (dist[to] == UNREACHED) return path;
+    path.push_back(to);
+    for (uint32_t v = to; v != from;) {
+        uint32_t best = Graph::NONE;
+        for (uint32_t u : g.in(v))
+            if (dist[u] + 1 == dist[v] && u < best) best = u;
+        v = best;
+        path.push_back(v);
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+// Strongly connected components (iterative Tarjan). Fills comp[v] with
+// a component number, numbered in the order components complete, which
+// is a reverse topological order of the condensation. Returns the count.
+inline uint32_t stronglyConnected(const Graph& g, std::vector<uint32_t>& comp) {
+    const size_t n = g.num_nodes();
+    std::vector<uint32_t> index(n, UNREACHED), low(n);
+    std::vector<uint8_t> on_stack(n, 0);
+    std::vector<uint32_t> stack;
+    struct Frame {
+        uint32_t v;
+        const uint32_t* next;   // next out-edge to visit
+    };
+    std::vector<Frame> calls;
+    comp.assign(n, UNREACHED);
+    uint32_t counter = 0, components = 0;
+
+    for (uint32_t root = 0; root < n; ++root) {
+        if (index[root] != UNREACHED) continue;
+        index[root] = low[root] = counter++;
+        stack.push_back(root);
+        on_stack[root] = 1;
+        calls.push_back(Frame{root, g.out(root).begin()});
+        while (!calls.empty()) {
+            Frame& f = calls.back();
+            uint32_t v = f.v;
+            if (f.next != g.out(v).end()) {
+                uint32_t t = *f.next++;
+                if (index[t] == UNREACHED) {
+                    index[t] = low[t] = counter++;
+                    stack.push_back(t);
+                    on_stack[t] = 1;
+                    calls.push_back(Frame{t, g.out(t).begin()});   // invalidates f
+                } else if (on_stack[t]) {
+                    low[v] = std::min(low[v], index[t]);
+                }
+                continue;
+            }
+            // v is done: pop its component if it is a root, then return to the caller
+            if (low[v] == index[v]) {
+                uint32_t w;
+                do {
+                    w = stack.back();
+                    stack.pop_back();
+                    on_stack[w] = 0;
+                    comp[w] = components;
+                } while (w != v);
+                ++components;
+            }
+            calls.pop_back();
+            if (!calls.empty()) {
+                uint32_t parent = calls.back().v;
+                low[parent] = std::min(low[parent], low[v]);
+            }
+        }
+    }
+    return components;
+}
+
+// Topological order (Kahn, ties broken by lowest id). On a cyclic graph
+// returns false and fills `cycle` with one cycle, first node repeated
+// at the end.
+inline bool topoOrder(const Graph& g, std::vector<uint32_t>& order, std::vector<uint32_t>& cycle) {
+    const size_t n = g.num_nodes();
+    std::vector<uint32_t> indegree(n);
+    for (uint32_t v = 0; v < n; ++v) indegree[v] = static_cast<uint32_t>(g.in(v).size());
+
+    // Lowest id first among ready nodes: a min-heap over a vector
+    std::vector<uint32_t> ready;
+    for (uint32_t v = 0; v < n; ++v)
+        if (indegree[v] == 0) ready.push_back(v);
+    std::make_heap(ready.begin(), ready.end(), std::greater<uint32_t>());
+    order.clear();
+    cycle.clear();
+    while (!ready.empty()) {
+        std::pop_heap(ready.begin(), ready.end(), std::greater<uint32_t>());
+        uint32_t v = ready.back();
+        ready.pop_back();
+        order.push_back(v);
+        for (uint32_t t : g.out(v)) {
+            if (--indegree[t] == 0) {
+                ready.push_back(t);
+                std::push_heap(ready.begin(), ready.end(), std::greater<uint32_t>());
+            }
+        }
+    }
+    if (order.size() == n) return true;
+
+    // Every node left has an in-edge from another node left, so walking
+    // those edges backwards must come round to a node already seen
+    uint32_t v = 0;
+    while (indegree[v] == 0) ++v;
+    std::vector<uint32_t> seen_at(n, UNREACHED);
+    std::vector<uint32_t> walk;
+    while (seen_at[v] == UNREACHED) {
+        seen_at[v] = static_cast<uint32_t>(walk.size());
+        walk.push_back(v);
+        for (uint32_t u : g.in(v)) {
+            if (indegree[u] != 0) {
+                v = u;
+                break;
+            }
+        }
+    }
+    cycle.assign(walk.begin() + seen_at[v], walk.end());
+    std::reverse(cycle.begin(), cycle.end());
+    cycle.push_back(cycle.front());
+    return false;
+}
+
+struct DegreeHistogram {
+    std::vector<uint64_t> out, in;   // [d] = number of nodes with that degree
+};
+
+inline DegreeHistogram degreeHistogram(const Graph& g) {
+    const size_t n = g.num_nodes();
+    size_t blocks = (n + ANALYTICS_BLOCK - 1) / ANALYTICS_BLOCK;
+    std::vector<DegreeHistogram> local(blocks);
+    parallelFor(blocks, [&](size_t b) {
+        DegreeHistogram& h = local[b];
+        size_t end = std::min(n, (b + 1) * ANALYTICS_BLOCK);
+        for (size_t v = b * ANALYTICS_BLOCK; v < end; ++v) {
+            size_t o = g.out(static_cast<uint32_t>(v)).size(), i = g.in(static_cast<uint32_t>(v)).size();
+            if (h.out.size() <= o) h.out.resize(o + 1);
+            if (h.in.size() <= i) h.in.resize(i + 1);
+            ++h.out[o];
+            ++h.in[i];
+        }
+    });
+    DegreeHistogram total;
+    for (const DegreeHistogram& h : local) {
+        if (total.out.size() < h.out.size()) total.out.resize(h.out.size());
+        if (total.in.size() < h.in.size()) total.in.resize(h.in.size());
+        for (size_t d = 0; d < h.out.size(); ++d) total.out[d] += h.out[d];
+        for (size_t d = 0; d < h.in.size(); ++d) total.in[d] += h.in[d];
+    }
+    return total;
+}
+
+// PageRank by power iteration, pulling along in-edges so each node's
+// new rank is written by one thread with no atomics. Rank held by nodes
+// without out-edges is spread over all nodes. Stops after `iterations`
+// rounds or once the ranks move less than `tolerance` in total (L1).
+inline std::vector<double> pageRank(const Graph& g, unsigned iterations, double damping, double tolerance,
+                                    unsigned* rounds = nullptr) {
+    const size_t n = g.num_nodes();
+    std::vector<double> rank(n, n ? 1.0 / n : 0.0), next(n), share(n);
+    size_t blocks = (n + ANALYTICS_BLOCK - 1) / ANALYTICS_BLOCK;
+    std::vector<double> partial(blocks);
+    unsigned done = 0;
+    while (done < iterations) {
+        ++done;
+        // What each node passes along each out-edge; dangling rank per block
+        parallelFor(blocks, [&](size_t b) {
+            double dangling = 0;
+            size_t end = std::min(n, (b + 1) * ANALYTICS_BLOCK);
+            for (size_t v = b * ANALYTICS_BLOCK; v < end; ++v) {
+                size_t d = g.out(static_cast<uint32_t>(v)).size();
+                share[v] = d ? rank[v] / d : 0.0;
+                if (!d) dangling += rank[v];
+            }
+            partial[b] = dangling;
+        });
+        double dangling = 0;
+        for (double p : partial) dangling += p;
+        const double base = (1.0 - damping) / n + damping * dangling / n;
+
+        parallelFor(blocks, [&](size_t b) {
+            double moved = 0;
+            size_t end = std::min(n, (b + 1) * ANALYTICS_BLOCK);
+            for (size_t v = b * ANALYTICS_BLOCK; v < end; ++v) {
+                double sum = 0;
+                for (uint32_t u : g.in(static_cast<uint32_t>(v))) sum += share[u];
+                next[v] = base + damping * sum;
+                moved += std::fabs(next[v] - rank[v]);
+            }
+            partial[b] = moved;
+        });
+        rank.swap(next);
+        double moved = 0;
+        for (double p : partial) moved += p;
+        if (moved < tolerance) break;
+    }
+    if (rounds) *rounds = done;
+    return rank;
+}
+
+enum Direction { DIRECTION_OUT, DIRECTION_IN, DIRECTION_BOTH };
+
+// Nodes at most `hops` edges from any of `seeds`, following edges the
+// given way, in id order. Visited nodes live in a hash map rather than
+// an array over all nodes, so the cost depends only on how many nodes
+// are reached: a small neighbourhood of a huge graph takes milliseconds.
+inline std::vector<uint32_t> neighbourhood(const Graph& g, const std::vector<uint32_t>& seeds, unsigned hops,
+                                           Direction direction) {
+    std::unordered_map<uint32_t, uint32_t> dist;
+    std::vector<uint32_t> frontier, next;
+    for (uint32_t s : seeds) {
+        if (dist.emplace(s, 0).second) frontier.push_back(s);
+    }
+    for (uint32_t level = 1; level <= hops && !frontier.empty(); ++level) {
+        next.clear();
+        auto visit = [&](Graph::Range r) {
+            for (uint32_t t : r) {
+                if (dist.emplace(t, level).second) next.push_back(t);
+            }
+        };
+        for (uint32_t v : frontier) {
+            if (direction != DIRECTION_IN) visit(g.out(v));
+            if (direction != DIRECTION_OUT) visit(g.in(v));
+        }
+        frontier.swap(next);
+    }
+    std::vector<uint32_t> nodes;
+    nodes.reserve(dist.size());
+    for (const auto& d : dist) nodes.push_back(d.first);
+    std::sort(nodes.begin(), nodes.end());
+    return nodes;
+}
+
+// The subgraph of `g` induced by `nodes` (sorted ids) into the empty
+// graph `out`, built and ready to write. Ids keep their relative order
+// and edges their input order, so output stays deterministic. Names
+// and labels are views into `g`, which must outlive `out`.
+inline void inducedSubgraph(const Graph& g, const std::vector<uint32_t>& nodes, Graph& out) {
+    for (uint32_t v : nodes) {
+        if (g.declared(v))
+            out.add_node(g.name(v), g.label(v));
+        else
+            out.intern(g.name(v));
+    }
+    for (uint32_t v : nodes) {
+        for (uint32_t t : g.out(v)) {
+            if (std::binary_search(nodes.begin(), nodes.end(), t)) out.add_edge(g.name(v), g.name(t));
+        }
+    }
+    out.build();
+}
+
+#endif // ANALYTICS_H
@@ -0,0 +1,147 @@
+#include <tinyxml2.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include "graphml_stream.h"
+
+using namespace tinyxml2;
+
+// Reading speed and peak memory of the tinyxml2 DOM path vs GraphmlReader.
+// Run each mode in its own process so peak RSS is per mode:
+//
+//   bench_graphml --generate 1000000 bench.graphml
+//   bench_graphml --dom bench.graphml
+//   bench_graphml --stream bench.graphml
+
+// yEd-style file: a ShapeNode with a NodeLabel per node, ~2 edges per node
+static int generate(long long n, const std::string& filename) {
+    std::ofstream out(filename);
+    if (!out) {
+        std::cerr << "Cannot open file: " << filename << "\n";
+        return 1;
+    }
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n"
+           "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\" xmlns:y=\"http://www.yworks.com/xml/graphml\">\n"
+           "  <key for=\"node\" id=\"d6\" yfiles.type=\"nodegraphics\"/>\n"
+           "  <key for=\"edge\" id=\"d10\" yfiles.type=\"edgegraphics\"/>\n"
+           "  <graph edgedefault=\"directed\" id=\"G\">\n";
+    std::mt19937_64 rng(42);
+    for (long long i = 0; i < n; ++i) {
+        out << "    <node id=\"n" << i << "\">\n"
+               "      <data key=\"d6\">\n"
+               "        <y:ShapeNode>\n"
+               "          <y:Geometry height=\"30.0\" width=\"80.0\" x=\"" << (i % 1000) * 100 << ".0\" y=\"" << (i / 1000) * 50 << ".0\"/>\n"
+               "          <y:Fill color=\"#FFCC00\" transparent=\"false\"/>\n"
+               "          <y:NodeLabel alignment=\"center\" fontFamily=\"Dialog\" fontSize=\"12\">Topic " << i
+            << (i % 7 == 0 ? " &amp; &quot;notes&quot;" : "") << "<y:LabelModel><y:SmartNodeLabelModel distance=\"4.0\"/></y:LabelModel></y:NodeLabel>\n"
+               "          <y:Shape type=\"roundrectangle\"/>\n"
+               "        </y:ShapeNode>\n"
+               "      </data>\n"
+               "    </node>\n";
+    }
+    for (long long i = 0; i < 2 * n && n > 1; ++i) {
+        long long s = i < n ? i : static_cast<long long>(rng() % n);
+        long long t = i < n ? (i + 1) % n : static_cast<long long>(rng() % n);
+        out << "    <edge id=\"e" << i << "\" source=\"n" << s << "\" target=\"n" << t << "\">\n"
+               "      <data key=\"d10\">\n"
+               "        <y:PolyLineEdge>\n"
+               "          <y:LineStyle color=\"#000000\" type=\"line\" width=\"1.0\"/>\n"
+               "          <y:Arrows source=\"none\" target=\"standard\"/>\n"
+               "        </y:PolyLineEdge>\n"
+               "      </data>\n"
+               "    </edge>\n";
+    }
+    out << "  </graph>\n</graphml>\n";
+    return 0;
+}
+
+static void collectLabel(XMLElement* elem, std::string& out) {
+    for (XMLElement* child = elem->FirstChildElement(); child; child = child->NextSiblingElement()) {
+        if (std::strstr(child->Name(), "NodeLabel") && child->GetText()) {
+            if (!out.empty()) out += ' ';
+            out += child->GetText();
+        }
+        collectLabel(child, out);
+    }
+}
+
+static void walkDom(XMLElement* graph, long long& nodes, long long& edges, long long& label_bytes) {
+    for (XMLElement* node = graph->FirstChildElement("node"); node; node = node->NextSiblingElement("node")) {
+        std::string label;
+        collectLabel(node, label);
+        label_bytes += label.size();
+        ++nodes;
+        for (XMLElement* inner = node->FirstChildElement("graph"); inner; inner = inner->NextSiblingElement("graph"))
+            walkDom(inner, nodes, edges, label_bytes);
+    }
+    for (XMLElement* edge = graph->FirstChildElement("edge"); edge; edge = edge->NextSiblingElement("edge"))
+        if (edge->Attribute("source") && edge->Attribute("target")) ++edges;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " --generate N file.graphml | --dom file.graphml | --stream file.graphml\n";
+        return 1;
+    }
+    std::string mode = argv[1];
+    if (mode == "--generate") {
+        if (argc < 4) {
+            std::cerr << "Usage: " << argv[0] << " --generate N file.graphml\n";
+            return 1;
+        }
+        return generate(std::atoll(argv[2]), argv[3]);
+    }
+
+    std::string filename = argv[2];
+    long long nodes = 0, edges = 0, label_bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    if (mode == "--dom") {
+        XMLDocument doc;
+        if (doc.LoadFile(filename.c_str()) != XML_SUCCESS) {
+            std::cerr << "Failed to load XML file: " << filename << "\n";
+            return 1;
+        }
+        XMLElement* root = doc.RootElement();
+        for (XMLElement* graph = root ? root->FirstChildElement("graph") : nullptr; graph; graph = graph->NextSiblingElement("graph"))
+            walkDom(graph, nodes, edges, label_bytes);
+    } else if (mode == "--stream") {
+        GraphmlReader reader(filename);
+        GraphmlRecord r;
+        while (reader.next(r)) {
+            if (r.kind == GraphmlRecord::NODE) {
+                ++nodes;
+                label_bytes += r.label.size();
+            } else {
+                ++edges;
+            }
+        }
+        if (!reader.error().empty()) {
+            std::cerr << "Failed to read GraphML file " << filename << ": " << reader.error() << "\n";
+            return 1;
+        }
+    } else {
+        std::cerr << "Unknown mode: " << mode << "\n";
+        return 1;
+    }
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    double mb = static_cast<double>(in.tellg()) / 1e6;
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    long peak_kb = ru.ru_maxrss / 1024;   // bytes on macOS
+#else
+    long peak_kb = ru.ru_maxrss;          // kilobytes on Linux
+#endif
+    std::printf("%-8s %lld nodes, %lld edges, %lld label bytes: %.1f MB in %.3f s = %.0f MB/s, peak RSS %.1f MB\n",
+                mode.c_str() + 2, nodes, edges, label_bytes, mb, secs, mb / secs, peak_kb / 1024.0);
+    return 0;
+}
@@ -1,85 +1,288 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <memory>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <vector>
+#include "analytics.h"
+#include "csv_mmap.h"
+#include "graph.h"
+#include "writer.h"
 
-int main(int argc, char** argv) {
-    if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " nodes.csv edges.csv\n";
+// Converts nodes.csv/edges.csv to DOT (or --format), or with a subcommand first
+// analyses the graph instead (see USAGE and analytics.h). Results are
+// CSV on stdout with a header line; node ids are quoted when needed.
+// All output goes through Writer (writer.h).
+//
+// The graph is cached next to the edges file as <edges.csv>.snap. A
+// snapshot made from the same two CSVs (same size and mtime) is mapped
+// and used as is; otherwise the CSVs are parsed and a new one written.
+
+static const char* USAGE =
+    " [command] [options] nodes.csv edges.csv\n"
+    "Commands (default: write the graph as DOT):\n"
+    "  bfs FROM        hops from FROM to every reachable node\n"
+    "  path FROM TO    a shortest path from FROM to TO\n"
+    "  scc             strongly connected component of every node\n"
+    "  topo            topological order, or a cycle if there is one\n"
+    "  degrees         histogram of in- and out-degrees\n"
+    "  pagerank        PageRank of every node, highest first\n"
+    "Options:\n"
+    "  --no-snapshot       neither read nor write <edges.csv>.snap\n"
+    "  --verify-snapshot   checksum the whole snapshot before using it\n"
+    "  --format F          dot (default), graphml, json, edgelist or svg\n"
+    "  --layout            lay the graph out and add pos= to DOT (implied by svg)\n"
+    "  --layout-iterations N  force-directed rounds (default 100)\n"
+    "  --focus ID          only the nodes near ID (repeatable), then as above\n"
+    "  --hops K            focus: how many edges out to go (default 1)\n"
+    "  --direction D       focus: follow edges out, in or both (default)\n"
+    "  --iterations N      pagerank: at most N rounds (default 100)\n"
+    "  --damping D         pagerank: damping factor (default 0.85)\n";
+
+static const char* COMMANDS[] = {"bfs", "path", "scc", "topo", "degrees", "pagerank"};
+
+static bool lookup(const Graph& graph, const std::string& name, uint32_t& v) {
+    v = graph.find(name);
+    if (v == Graph::NONE) std::cerr << "Unknown node: " << name << "\n";
+    return v != Graph::NONE;
+}
+
+static int runBfs(const Graph& graph, Writer& w, const std::string& from) {
+    uint32_t source;
+    if (!lookup(graph, from, source)) return 1;
+    std::vector<uint32_t> dist = bfsDistances(graph, source);
+    std::vector<uint32_t> reached;
+    for (uint32_t v = 0; v < graph.num_nodes(); ++v)
+        if (dist[v] != UNREACHED) reached.push_back(v);
+    std::stable_sort(reached.begin(), reached.end(), [&](uint32_t a, uint32_t b) { return dist[a] < dist[b]; });
+    w.write("id,distance\n");
+    for (uint32_t v : reached) w.csv_field(graph.name(v)).put(',').number(static_cast<uint64_t>(dist[v])).put('\n');
+    return 0;
+}
+
+static int runPath(const Graph& graph, Writer& w, const std::string& from, const std::string& to) {
+    uint32_t source, target;
+    if (!lookup(graph, from, source) || !lookup(graph, to, target)) return 1;
+    std::vector<uint32_t> path = shortestPath(graph, source, target);
+    if (path.empty()) {
+        std::cerr << "No path from " << from << " to " << to << "\n";
         return 1;
     }
+    w.write("id\n");
+    for (uint32_t v : path) w.csv_field(graph.name(v)).put('\n');
+    return 0;
+}
 
-    std::string nodes_file = argv[1];
-    std::string edges_file = argv[2];
-
-    // Map node_id -> label
-    std::unordered_map<std::string, std::string> nodes;
+static int runScc(const Graph& graph, Writer& w) {
+    std::vector<uint32_t> comp;
+    uint32_t count = stronglyConnected(graph, comp);
+    std::vector<uint32_t> size(count, 0);
+    for (uint32_t c : comp) ++size[c];
+    w.write("id,component\n");
+    for (uint32_t v = 0; v < graph.num_nodes(); ++v)
+        w.csv_field(graph.name(v)).put(',').number(static_cast<uint64_t>(comp[v])).put('\n');
+    std::cerr << count << " strongly connected components, largest has "
+              << (count ? *std::max_element(size.begin(), size.end()) : 0) << " nodes\n";
+    return 0;
+}
 
-    // Read nodes.csv
-    std::ifstream nfile(nodes_file);
-    if (!nfile) {
-        std::cerr << "Cannot open file: " << nodes_file << "\n";
+static int runTopo(const Graph& graph, Writer& w) {
+    std::vector<uint32_t> order, cycle;
+    if (!topoOrder(graph, order, cycle)) {
+        std::cerr << "Graph has a cycle:";
+        for (size_t i = 0; i < cycle.size(); ++i) std::cerr << (i ? " -> " : " ") << graph.name(cycle[i]);
+        std::cerr << "\n";
         return 1;
     }
+    w.write("id\n");
+    for (uint32_t v : order) w.csv_field(graph.name(v)).put('\n');
+    return 0;
+}
 
-    std::string line;
-    // Skip header
-    std::getline(nfile, line);
+static int runDegrees(const Graph& graph, Writer& w) {
+    DegreeHistogram h = degreeHistogram(graph);
+    w.write("degree,out_nodes,in_nodes\n");
+    for (size_t d = 0; d < std::max(h.out.size(), h.in.size()); ++d) {
+        uint64_t o = d < h.out.size() ? h.out[d] : 0, i = d < h.in.size() ? h.in[d] : 0;
+        if (o || i) w.number(static_cast<uint64_t>(d)).put(',').number(o).put(',').number(i).put('\n');
+    }
+    return 0;
+}
 
-    while (std::getline(nfile, line)) {
-        std::stringstream ss(line);
-        std::string id, label;
+static int runPageRank(const Graph& graph, Writer& w, unsigned iterations, double damping) {
+    std::vector<double> rank = pageRank(graph, iterations, damping, 1e-10);
+    std::vector<uint32_t> order(graph.num_nodes());
+    for (uint32_t v = 0; v < order.size(); ++v) order[v] = v;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return rank[a] > rank[b]; });
+    w.write("id,rank\n");
+    for (uint32_t v : order) w.csv_field(graph.name(v)).put(',').number(rank[v]).put('\n');
+    return 0;
+}
 
-        if (!std::getline(ss, id, ',')) continue;
-        if (!std::getline(ss, label)) label = "";
+int main(int argc, char** argv) {
+    const char* program = argv[0];
+    std::string command;
+    for (const char* c : COMMANDS) {
+        if (argc > 1 && std::strcmp(argv[1], c) == 0) command = c;
+    }
+    if (!command.empty()) {
+        // Parse the rest as if the command were the program name
+        --argc;
+        ++argv;
+    }
+
+    bool use_snapshot = true;
+    bool verify_snapshot = false;
+    unsigned iterations = 100;
+    double damping = 0.85;
+    GraphFormat format = FORMAT_DOT;
+    bool layout = false;
+    std::vector<std::string> focus;
+    unsigned hops = 1;
+    Direction direction = DIRECTION_BOTH;
+    LayoutOptions layout_options;
+
+    static struct option long_options[] = {
+        {"no-snapshot", no_argument, 0, 'n'},
+        {"verify-snapshot", no_argument, 0, 'v'},
+        {"iterations", required_argument, 0, 'i'},
+        {"damping", required_argument, 0, 'd'},
+        {"format", required_argument, 0, 'f'},
+        {"layout", no_argument, 0, 'l'},
+        {"layout-iterations", required_argument, 0, 'L'},
+        {"focus", required_argument, 0, 'F'},
+        {"hops", required_argument, 0, 'k'},
+        {"direction", required_argument, 0, 'D'},
+        {0, 0, 0, 0}
+    };
 
-        nodes[id] = label;
+    int opt;
+    int option_index = 0;
+    while ((opt = getopt_long(argc, argv, "", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'n': use_snapshot = false; break;
+            case 'v': verify_snapshot = true; break;
+            case 'i': iterations = static_cast<unsigned>(std::atoi(optarg)); break;
+            case 'd': damping = std::atof(optarg); break;
+            case 'f':
+                if (!parseGraphFormat(optarg, format)) {
+                    std::cerr << "Unknown format: " << optarg << " (dot, graphml, json, edgelist or svg)\n";
+                    return 1;
+                }
+                break;
+            case 'l': layout = true; break;
+            case 'L': layout_options.iterations = static_cast<unsigned>(std::atoi(optarg)); break;
+            case 'F': focus.push_back(optarg); break;
+            case 'k': hops = static_cast<unsigned>(std::atoi(optarg)); break;
+            case 'D':
+                if (std::strcmp(optarg, "out") == 0) direction = DIRECTION_OUT;
+                else if (std::strcmp(optarg, "in") == 0) direction = DIRECTION_IN;
+                else if (std::strcmp(optarg, "both") == 0) direction = DIRECTION_BOTH;
+                else {
+                    std::cerr << "Unknown direction: " << optarg << " (in, out or both)\n";
+                    return 1;
+                }
+                break;
+            default:
+                std::cerr << "Usage: " << program << USAGE;
+                return 1;
+        }
     }
-    nfile.close();
 
-    // Read edges.csv
-    std::vector<std::pair<std::string,std::string>> edges;
-    std::ifstream efile(edges_file);
-    if (!efile) {
-        std::cerr << "Cannot open file: " << edges_file << "\n";
+    // Node arguments of the command come before the two files
+    int node_args = command == "bfs" ? 1 : command == "path" ? 2 : 0;
+    if (argc - optind != node_args + 2) {
+        std::cerr << "Usage: " << program << USAGE;
         return 1;
     }
+    std::vector<std::string> nodes(argv + optind, argv + optind + node_args);
+    optind += node_args;
 
-    // Skip header
-    std::getline(efile, line);
+    std::string nodes_file = argv[optind];
+    std::string edges_file = argv[optind + 1];
+    std::string snapshot_file = edges_file + ".snap";
 
-    while (std::getline(efile, line)) {
-        std::stringstream ss(line);
-        std::string src, dst;
-        if (!std::getline(ss, src, ',')) continue;
-        if (!std::getline(ss, dst)) continue;
+    SnapshotSources sources;
+    bool racy = false;
+    if (!snapshotSources(nodes_file, edges_file, sources, racy)) use_snapshot = false;
 
-        edges.emplace_back(src, dst);
-    }
-    efile.close();
-
-    // Output DOT graph
-    std::cout << "digraph G {\n";
-    // Nodes
-    for (auto &p : nodes) {
-        std::string id = p.first;
-        std::string label = p.second;
-        // Escape quotes in label
-        size_t pos = 0;
-        while ((pos = label.find('"', pos)) != std::string::npos) {
-            label.replace(pos, 1, "\\\"");
-            pos += 2;
+    // Both files stay mapped while the graph is in use: ids and labels
+    // are views into them
+    std::unique_ptr<MappedFile> nmap, emap;
+    Graph graph;
+
+    std::string error;
+    if (use_snapshot && !graph.open_snapshot(snapshot_file, sources, verify_snapshot, error) && !error.empty())
+        std::cerr << "Ignoring " << snapshot_file << ": " << error << "\n";
+
+    if (!graph.from_snapshot()) {
+        nmap = std::make_unique<MappedFile>(nodes_file);
+        if (!nmap->ok()) {
+            std::cerr << nmap->error() << "\n";
+            return 1;
+        }
+        emap = std::make_unique<MappedFile>(edges_file);
+        if (!emap->ok()) {
+            std::cerr << emap->error() << "\n";
+            return 1;
         }
-        std::cout << "    \"" << id << "\" [label=\"" << label << "\"];\n";
+
+        std::vector<CsvField> fields;
+
+        // Read nodes.csv, skipping the header; its nodes get the first ids
+        CsvReader nreader(nmap->view());
+        nreader.next(fields);
+        while (nreader.next(fields)) {
+            if (fields[0].text.empty()) continue;
+            graph.add_node(graph.unescaped(fields[0]), fields.size() > 1 ? graph.unescaped(fields[1]) : std::string_view());
+        }
+
+        // Read edges.csv, skipping the header, on all cores
+        CsvReader ereader(emap->view());
+        ereader.next(fields);
+        graph.load_edges(ereader.rest());
+        graph.build();
+
+        // A just-written CSV could still change without its times moving;
+        // the next run snapshots it instead
+        if (use_snapshot && !racy && !graph.save_snapshot(snapshot_file, sources))
+            std::cerr << "Cannot write snapshot: " << snapshot_file << "\n";
     }
 
-    // Edges
-    for (auto &e : edges) {
-        std::cout << "    \"" << e.first << "\" -> \"" << e.second << "\";\n";
+    // Everything below sees only the neighbourhood when focusing
+    Graph focused;
+    if (!focus.empty()) {
+        std::vector<uint32_t> seeds;
+        for (const std::string& name : focus) {
+            uint32_t v;
+            if (!lookup(graph, name, v)) return 1;
+            seeds.push_back(v);
+        }
+        inducedSubgraph(graph, neighbourhood(graph, seeds, hops, direction), focused);
     }
+    const Graph& view = focus.empty() ? graph : focused;
 
-    std::cout << "}\n";
+    Writer w(stdout);
+    int status = 0;
+    if (command == "bfs") status = runBfs(view, w, nodes[0]);
+    else if (command == "path") status = runPath(view, w, nodes[0], nodes[1]);
+    else if (command == "scc") status = runScc(view, w);
+    else if (command == "topo") status = runTopo(view, w);
+    else if (command == "degrees") status = runDegrees(view, w);
+    else if (command == "pagerank") status = runPageRank(view, w, iterations, damping);
+    else {
+        std::vector<LayoutPoint> positions;
+        if (layout || format == FORMAT_SVG) positions = forceLayout(view, layout_options);
+        writeGraph(view, format, w, positions.empty() && format != FORMAT_SVG ? nullptr : &positions);
+    }
 
-    return 0;
+    if (!w.flush()) {
+        std::cerr << "Cannot write output\n";
+        return 1;
+    }
+    return status;
 }
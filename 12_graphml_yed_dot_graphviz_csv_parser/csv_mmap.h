@@ -0,0 +1,180 @@
+#ifndef CSV_MMAP_H
+#define CSV_MMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Zero-copy CSV loading.
+//
+// MappedFile maps a whole file read-only; CsvReader walks it and returns
+// each record's fields as string_views into the mapping, so nothing is
+// copied or allocated per field. Delimiters are found 16 bytes at a time
+// with SSE2, or 8 at a time with plain 64-bit words elsewhere (arm64).
+//
+// Quoted fields (RFC 4180, as written by nodes and graphml2csv) come
+// back without their quotes. A field with doubled quotes inside keeps
+// them and is flagged; csvUnescape() makes the one copy it needs.
+
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error_ = "Cannot open file: " + path;
+            return;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            error_ = "Cannot stat file: " + path;
+            ::close(fd);
+            return;
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                error_ = "Cannot map file: " + path;
+                size_ = 0;
+            } else {
+                data_ = static_cast<const char*>(p);
+                ::madvise(p, size_, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool ok() const { return error_.empty(); }
+    const std::string& error() const { return error_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    std::string_view view() const { return std::string_view(data_, size_); }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    std::string error_;
+};
+
+struct CsvField {
+    std::string_view text;
+    bool escaped = false;   // text still contains doubled quotes
+};
+
+// Collapse the doubled quotes of a quoted field
+inline std::string csvUnescape(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        out += s[i];
+        if (s[i] == '"' && i + 1 < s.size() && s[i + 1] == '"') ++i;
+    }
+    return out;
+}
+
+// First byte in [p, end) equal to a or b, or end
+inline const char* findEither(const char* p, const char* end, char a, char b) {
+#if defined(__SSE2__)
+    const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+    for (; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+#else
+    // SWAR: a zero byte in word ^ broadcast(c) marks a match
+    const uint64_t ones = 0x0101010101010101ULL, highs = 0x8080808080808080ULL;
+    const uint64_t ba = ones * static_cast<uint8_t>(a), bb = ones * static_cast<uint8_t>(b);
+    for (; end - p >= 8; p += 8) {
+        uint64_t w;
+        std::memcpy(&w, p, 8);
+        uint64_t xa = w ^ ba, xb = w ^ bb;
+        uint64_t hit = ((xa - ones) & ~xa & highs) | ((xb - ones) & ~xb & highs);
+        if (hit) {
+            for (int i = 0; i < 8; ++i)
+                if (p[i] == a || p[i] == b) return p + i;
+        }
+    }
+#endif
+    for (; p < end; ++p)
+        if (*p == a || *p == b) return p;
+    return end;
+}
+
+class CsvReader {
+public:
+    explicit CsvReader(std::string_view data)
+        : p_(data.data()), end_(data.data() + data.size()) {}
+
+    // Fields of the next record; false at the end of the input. Blank
+    // lines are skipped. A '\r' before the newline is dropped.
+    bool next(std::vector<CsvField>& fields) {
+        fields.clear();
+        while (p_ < end_ && (*p_ == '\n' || *p_ == '\r')) ++p_;
+        if (p_ >= end_) return false;
+        ++records_;
+        for (;;) {
+            CsvField f;
+            bool quoted = p_ < end_ && *p_ == '"';
+            if (quoted) {
+                const char* start = ++p_;
+                for (;;) {
+                    const char* q = static_cast<const char*>(std::memchr(p_, '"', end_ - p_));
+                    if (!q) q = end_;
+                    if (q + 1 < end_ && q[1] == '"') {
+                        f.escaped = true;
+                        p_ = q + 2;
+                        continue;
+                    }
+                    f.text = std::string_view(start, q - start);
+                    p_ = q < end_ ? q + 1 : end_;
+                    break;
+                }
+                // Anything between the closing quote and the delimiter is dropped
+                p_ = findEither(p_, end_, ',', '\n');
+            } else {
+                const char* q = findEither(p_, end_, ',', '\n');
+                f.text = std::string_view(p_, q - p_);
+                p_ = q;
+            }
+            if (p_ == end_ || *p_ == '\n') {
+                if (!quoted && !f.text.empty() && f.text.back() == '\r') f.text.remove_suffix(1);
+                fields.push_back(f);
+                if (p_ < end_) ++p_;
+                return true;
+            }
+            fields.push_back(f);
+            ++p_;   // ','
+        }
+    }
+
+    // The input not read yet
+    std::string_view rest() const { return std::string_view(p_, end_ - p_); }
+
+    // Number of records returned so far (the header counts)
+    size_t records() const { return records_; }
+
+private:
+    const char* p_;
+    const char* end_;
+    size_t records_ = 0;
+};
+
+#endif // CSV_MMAP_H
@@ -1,16 +1,7 @@
-#include <tinyxml2.h>
 #include <iostream>
 #include <string>
 #include <getopt.h>
-
-using namespace tinyxml2;
-
-std::string leafID(const std::string& id, bool short_ids) {
-    if (!short_ids) return id;
-    auto pos = id.rfind("::");
-    if (pos != std::string::npos) return id.substr(pos + 2);
-    return id;
-}
+#include "graphml_stream.h"
 
 int main(int argc, char** argv) {
     bool short_ids = false;
@@ -39,28 +30,21 @@ int main(int argc, char** argv) {
 
     std::string filename = argv[optind];
 
-    XMLDocument doc;
-    if (doc.LoadFile(filename.c_str()) != XML_SUCCESS) {
-        std::cerr << "Failed to load XML file\n";
-        return 1;
-    }
-
-    XMLElement* root = doc.RootElement();
-    if (!root) {
-        std::cerr << "Invalid GraphML file\n";
-        return 1;
-    }
+    GraphmlReader reader(filename);
+    GraphmlRecord r;
 
+    std::ios::sync_with_stdio(false);
     std::cout << "source,target\n";
 
-    for (XMLElement* graphElem = root->FirstChildElement("graph"); graphElem; graphElem = graphElem->NextSiblingElement("graph")) {
-        for (XMLElement* edgeElem = graphElem->FirstChildElement("edge"); edgeElem; edgeElem = edgeElem->NextSiblingElement("edge")) {
-            const char* source = edgeElem->Attribute("source");
-            const char* target = edgeElem->Attribute("target");
-            if (!source || !target) continue;
+    while (reader.next(r)) {
+        // Only the top-level graph's edges, not those inside yEd groups
+        if (r.kind != GraphmlRecord::EDGE || r.depth != 1 || r.source.empty() || r.target.empty()) continue;
+        std::cout << csvField(leafID(r.source, short_ids)) << "," << csvField(leafID(r.target, short_ids)) << "\n";
+    }
 
-            std::cout << leafID(source, short_ids) << "," << leafID(target, short_ids) << "\n";
-        }
+    if (!reader.error().empty()) {
+        std::cerr << "Failed to read GraphML file " << filename << ": " << reader.error() << "\n";
+        return 1;
     }
 
     return 0;
@@ -0,0 +1,638 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "csv_mmap.h"
+#include "parallel.h"
+#include "snapshot.h"
+
+// Hash of a node name, 8 bytes at a time
+inline uint64_t hashName(std::string_view s) {
+    const uint64_t K = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = s.size() * K;
+    const char* p = s.data();
+    size_t n = s.size();
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t w;
+        std::memcpy(&w, p, 8);
+        h = (h ^ w) * K;
+        h ^= h >> 29;
+    }
+    if (n) {
+        uint64_t w = 0;
+        std::memcpy(&w, p, n);
+        h = (h ^ w) * K;
+    }
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+// Name -> dense id. Open addressing over one flat array of 32-byte
+// slots, each holding the id, 32 bits of the hash and, for names of up
+// to 20 bytes (nearly all of them), the name itself. A lookup then costs
+// one cache miss instead of three (slot, name table, name bytes), which
+// is what interning time is made of once the table outgrows the cache.
+// Longer names are compared through the caller's name table. Ids need
+// not be dense: a table can index any subset of the names.
+class NameIndex {
+public:
+    // Id of `name` (hashed to `h`), or UINT32_MAX
+    uint32_t find(std::string_view name, uint64_t h, const std::vector<std::string_view>& names) const {
+        if (slots_.empty()) return UINT32_MAX;
+        for (size_t i = h & mask_;; i = (i + 1) & mask_) {
+            const Slot& slot = slots_[i];
+            if (slot.id1 == 0) return UINT32_MAX;
+            if (matches(slot, h, name, names)) return slot.id1 - 1;
+        }
+    }
+
+    // Start loading the slot `h` will probe first
+    void prefetch(uint64_t h) const {
+        if (!slots_.empty()) __builtin_prefetch(&slots_[h & mask_]);
+    }
+
+    // Id of `name` (hashed to `h`), or `fresh` after recording it under that id
+    uint32_t insert(std::string_view name, uint64_t h, uint32_t fresh, const std::vector<std::string_view>& names) {
+        if ((used_ + 1) * 2 > slots_.size()) grow(names);
+        for (size_t i = h & mask_;; i = (i + 1) & mask_) {
+            Slot& slot = slots_[i];
+            if (slot.id1 == 0) {
+                fill(slot, h, fresh, name);
+                ++used_;
+                return fresh;
+            }
+            if (matches(slot, h, name, names)) return slot.id1 - 1;
+        }
+    }
+
+private:
+    static const size_t INLINE = 20;
+
+    struct Slot {
+        uint32_t id1;    // id + 1, 0 = empty
+        uint32_t tag;    // high half of the hash
+        uint32_t len;
+        char bytes[INLINE];
+    };
+
+    static bool matches(const Slot& slot, uint64_t h, std::string_view name,
+                        const std::vector<std::string_view>& names) {
+        if (slot.tag != static_cast<uint32_t>(h >> 32) || slot.len != name.size()) return false;
+        if (name.size() <= INLINE) return std::memcmp(slot.bytes, name.data(), name.size()) == 0;
+        return names[slot.id1 - 1] == name;
+    }
+
+    static void fill(Slot& slot, uint64_t h, uint32_t id, std::string_view name) {
+        slot.id1 = id + 1;
+        slot.tag = static_cast<uint32_t>(h >> 32);
+        slot.len = static_cast<uint32_t>(name.size());
+        if (name.size() <= INLINE) std::memcpy(slot.bytes, name.data(), name.size());
+    }
+
+    void grow(const std::vector<std::string_view>& names) {
+        std::vector<Slot> old;
+        old.swap(slots_);
+        size_t size = old.empty() ? 64 : old.size() * 2;
+        slots_.assign(size, Slot());
+        mask_ = size - 1;
+        for (const Slot& o : old) {
+            if (o.id1 == 0) continue;
+            uint32_t id = o.id1 - 1;
+            uint64_t h = hashName(names[id]);
+            size_t i = h & mask_;
+            while (slots_[i].id1 != 0) i = (i + 1) & mask_;
+            slots_[i] = o;
+        }
+    }
+
+    std::vector<Slot> slots_;
+    size_t mask_ = 0;
+    uint32_t used_ = 0;
+};
+
+// In-memory graph for csv2dot.
+//
+// Node names are interned to dense uint32 ids in order of first
+// appearance, so nodes.csv order comes first. Edges are kept in
+// compressed sparse row form in both directions: out(v) lists v's
+// targets, in(v) its sources, each as a contiguous run of ids. That is
+// 8 bytes per edge plus 16 per node for the offsets. Names and labels
+// are string_views into the caller's mapped CSVs (or into strings the
+// graph owns, see own()).
+//
+// Fill with add_node()/add_edge() or load_edges(), then call build()
+// once. Within a node's run, edges keep their input order.
+//
+// load_edges() parses a large edge list on all cores and gives every
+// node the same id a sequential load would:
+//   1. the input is cut into one newline-aligned chunk per thread, each
+//      parsed into its own edge list over chunk-local ids and a
+//      chunk-local dictionary;
+//   2. the names are merged into the shared dictionary, which is split
+//      into NAME_SHARDS shards by hash so each shard merges on its own
+//      thread, visiting chunks in order. The first chunk to mention a
+//      new name owns it;
+//   3. new names are numbered chunk by chunk in the order their owners
+//      first met them (a prefix sum gives each chunk its first id), then
+//      every chunk rewrites its edges to global ids at its own offset.
+//
+// A built graph can be saved as a snapshot (snapshot.h) and reopened
+// later without parsing anything: open_snapshot() maps the file and
+// points the accessors at its arrays. find() then binary-searches the
+// snapshot's ids sorted by name instead of a hash index.
+
+class Graph {
+public:
+    static const uint32_t NONE = UINT32_MAX;
+
+    struct Range {
+        const uint32_t* b;
+        const uint32_t* e;
+        const uint32_t* begin() const { return b; }
+        const uint32_t* end() const { return e; }
+        size_t size() const { return e - b; }
+    };
+
+    uint32_t intern(std::string_view name) {
+        flush_edges();
+        return intern(name, hashName(name));
+    }
+
+    // A node listed in nodes.csv (the last label wins)
+    void add_node(std::string_view name, std::string_view label) {
+        uint32_t v = intern(name);
+        labels_[v] = label;
+        declared_[v] = 1;
+    }
+
+    // Edges are interned in batches: hashing a batch and prefetching its
+    // slots first overlaps the cache misses that dominate interning
+    void add_edge(std::string_view source, std::string_view target) {
+        pending_.push_back(source);
+        pending_.push_back(target);
+        if (pending_.size() == EDGE_BATCH * 2) flush_edges();
+    }
+
+    // Keep a string alive as long as the graph, for names and labels
+    // that are not views into the input (unescaped CSV fields)
+    std::string_view own(std::string s) {
+        owned_.push_back(std::move(s));
+        return owned_.back();
+    }
+
+    // Sort the edge list into both CSR arrays and free it
+    void build() {
+        flush_edges();
+        const size_t n = names_.size();
+        count_sort(edge_src_, edge_dst_, n, out_offsets_, out_targets_);
+        std::vector<uint32_t>().swap(edge_src_);
+        std::vector<uint32_t>().swap(edge_dst_);
+
+        // in-edges: transpose the out CSR, visiting sources in id order
+        in_offsets_.assign(n + 1, 0);
+        for (uint32_t t : out_targets_) ++in_offsets_[t + 1];
+        for (size_t v = 0; v < n; ++v) in_offsets_[v + 1] += in_offsets_[v];
+        in_sources_.resize(out_targets_.size());
+        std::vector<uint64_t> next(in_offsets_.begin(), in_offsets_.end() - 1);
+        for (size_t v = 0; v < n; ++v)
+            for (uint64_t i = out_offsets_[v]; i < out_offsets_[v + 1]; ++i)
+                in_sources_[next[out_targets_[i]]++] = static_cast<uint32_t>(v);
+
+        nodes_ = n;
+        edges_ = out_targets_.size();
+        declared_view_ = declared_.data();
+        out_offsets_view_ = out_offsets_.data();
+        out_targets_view_ = out_targets_.data();
+        in_offsets_view_ = in_offsets_.data();
+        in_sources_view_ = in_sources_.data();
+    }
+
+    uint32_t find(std::string_view name) const {
+        if (snapshot_) {
+            // Binary search of the snapshot's ids sorted by name: O(log n) pages touched
+            const uint32_t* b = name_order_view_;
+            const uint32_t* e = name_order_view_ + nodes_;
+            const uint32_t* it =
+                std::lower_bound(b, e, name, [&](uint32_t v, std::string_view x) { return this->name(v) < x; });
+            return it != e && this->name(*it) == name ? *it : NONE;
+        }
+        uint64_t h = hashName(name);
+        return index_[shard(h)].find(name, h, names_);
+    }
+
+    // Write the built graph to `path` (through a temporary file renamed
+    // over it, so readers never see half a snapshot)
+    bool save_snapshot(const std::string& path, const SnapshotSources& sources) const {
+        std::string tmp = path + ".tmp";
+        SnapshotWriter w(tmp);
+        if (!w.ok()) return false;
+
+        w.begin(SNAP_STRINGS);
+        for (uint32_t v = 0; v < nodes_; ++v) w.write(name(v).data(), name(v).size());
+        for (uint32_t v = 0; v < nodes_; ++v) w.write(label(v).data(), label(v).size());
+        w.end();
+        uint64_t at = 0;
+        w.begin(SNAP_NAME_OFFSETS);
+        for (uint32_t v = 0; v < nodes_; ++v) {
+            w.write(&at, sizeof(at));
+            at += name(v).size();
+        }
+        w.write(&at, sizeof(at));
+        w.end();
+        w.begin(SNAP_LABEL_OFFSETS);
+        for (uint32_t v = 0; v < nodes_; ++v) {
+            w.write(&at, sizeof(at));
+            at += label(v).size();
+        }
+        w.write(&at, sizeof(at));
+        w.end();
+        w.begin(SNAP_DECLARED);
+        w.write(declared_view_, nodes_);
+        w.end();
+        w.begin(SNAP_OUT_OFFSETS);
+        w.write(out_offsets_view_, (nodes_ + 1) * sizeof(uint64_t));
+        w.end();
+        w.begin(SNAP_OUT_TARGETS);
+        w.write(out_targets_view_, edges_ * sizeof(uint32_t));
+        w.end();
+        w.begin(SNAP_IN_OFFSETS);
+        w.write(in_offsets_view_, (nodes_ + 1) * sizeof(uint64_t));
+        w.end();
+        w.begin(SNAP_IN_SOURCES);
+        w.write(in_sources_view_, edges_ * sizeof(uint32_t));
+        w.end();
+        std::vector<uint32_t> by_name(nodes_);
+        for (uint32_t v = 0; v < nodes_; ++v) by_name[v] = v;
+        std::sort(by_name.begin(), by_name.end(), [&](uint32_t a, uint32_t b) { return name(a) < name(b); });
+        w.begin(SNAP_NAME_ORDER);
+        w.write(by_name.data(), nodes_ * sizeof(uint32_t));
+        w.end();
+
+        if (!w.finish(sources, nodes_, edges_) || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Use the snapshot at `path` instead of building, if it exists and
+    // was made from `sources`. With `verify` every section's checksum is
+    // checked too. False leaves the graph empty; `error` says why when
+    // the file was there but unusable for a reason other than staleness.
+    bool open_snapshot(const std::string& path, const SnapshotSources& sources, bool verify, std::string& error) {
+        error.clear();
+        auto file = std::make_unique<MappedFile>(path);
+        if (!file->ok()) return false;
+        SnapshotHeader h;
+        if (file->size() < sizeof(h)) {
+            error = "truncated header";
+            return false;
+        }
+        std::memcpy(&h, file->data(), sizeof(h));
+        if (std::memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0 || h.version != SNAPSHOT_VERSION ||
+            h.sections != SNAP_SECTIONS) {
+            error = "not a version " + std::to_string(SNAPSHOT_VERSION) + " snapshot";
+            return false;
+        }
+        if (headerChecksum(h) != h.header_checksum) {
+            error = "header checksum mismatch";
+            return false;
+        }
+        if (!(h.sources == sources)) return false;   // stale
+
+        const uint64_t n = h.num_nodes, m = h.num_edges;
+        if (n >= NONE || m > file->size()) {   // ids are 32-bit; and keep the sizes below from overflowing
+            error = "bad section table";
+            return false;
+        }
+        const uint64_t expect[SNAP_SECTIONS] = {h.section[SNAP_STRINGS].bytes, (n + 1) * 8, (n + 1) * 8, n,
+                                                (n + 1) * 8, m * 4, (n + 1) * 8, m * 4, n * 4};
+        for (size_t s = 0; s < SNAP_SECTIONS; ++s) {
+            const auto& sec = h.section[s];
+            if (sec.offset % 8 != 0 || sec.bytes != expect[s] || sec.offset > file->size() ||
+                sec.bytes > file->size() - sec.offset) {
+                error = "bad section table";
+                return false;
+            }
+            if (verify) {
+                Checksum c;
+                c.update(file->data() + sec.offset, sec.bytes);
+                if (c.value() != sec.checksum) {
+                    error = "section " + std::to_string(s) + " checksum mismatch";
+                    return false;
+                }
+            }
+        }
+        // Everything below is used unchecked, so a damaged file must not
+        // get past here even without --verify-snapshot
+        auto at = [&](SnapshotSection s) { return file->data() + h.section[s].offset; };
+        auto offsets = [&](SnapshotSection s) { return reinterpret_cast<const uint64_t*>(at(s)); };
+        auto ids = [&](SnapshotSection s) { return reinterpret_cast<const uint32_t*>(at(s)); };
+        const uint64_t* names = offsets(SNAP_NAME_OFFSETS);
+        if (!ascending(names, n, 0, names[n]) ||
+            !ascending(offsets(SNAP_LABEL_OFFSETS), n, names[n], h.section[SNAP_STRINGS].bytes) ||
+            !ascending(offsets(SNAP_OUT_OFFSETS), n, 0, m) || !ascending(offsets(SNAP_IN_OFFSETS), n, 0, m)) {
+            error = "inconsistent offsets";
+            return false;
+        }
+        if (!below(ids(SNAP_OUT_TARGETS), m, n) || !below(ids(SNAP_IN_SOURCES), m, n) ||
+            !below(ids(SNAP_NAME_ORDER), n, n)) {
+            error = "node id out of range";
+            return false;
+        }
+
+        nodes_ = n;
+        edges_ = m;
+        strings_ = at(SNAP_STRINGS);
+        name_offsets_view_ = offsets(SNAP_NAME_OFFSETS);
+        label_offsets_view_ = offsets(SNAP_LABEL_OFFSETS);
+        declared_view_ = reinterpret_cast<const uint8_t*>(at(SNAP_DECLARED));
+        out_offsets_view_ = offsets(SNAP_OUT_OFFSETS);
+        out_targets_view_ = reinterpret_cast<const uint32_t*>(at(SNAP_OUT_TARGETS));
+        in_offsets_view_ = offsets(SNAP_IN_OFFSETS);
+        in_sources_view_ = reinterpret_cast<const uint32_t*>(at(SNAP_IN_SOURCES));
+        name_order_view_ = reinterpret_cast<const uint32_t*>(at(SNAP_NAME_ORDER));
+        snapshot_ = std::move(file);
+        return true;
+    }
+
+    // o[0..n] runs from `first` to `last` without going down
+    static bool ascending(const uint64_t* o, uint64_t n, uint64_t first, uint64_t last) {
+        if (o[0] != first || o[n] != last) return false;
+        bool bad = false;
+        for (uint64_t i = 0; i < n; ++i) bad |= o[i] > o[i + 1];
+        return !bad;
+    }
+
+    // Every one of the `count` ids is below n
+    static bool below(const uint32_t* ids, uint64_t count, uint64_t n) {
+        uint32_t top = 0;
+        for (uint64_t i = 0; i < count; ++i) top = std::max(top, ids[i]);
+        return count == 0 || top < n;
+    }
+
+    // Text of a CSV field, unescaped into a string the graph owns if needed
+    std::string_view unescaped(const CsvField& f) {
+        return f.escaped ? own(csvUnescape(f.text)) : f.text;
+    }
+
+    // Add the edges of a CSV body (no header) of source,target lines.
+    // Input with quotes is parsed sequentially: a quoted field may hold
+    // a newline, which chunk boundaries cannot see.
+    void load_edges(std::string_view csv) {
+        std::vector<CsvField> fields;
+        unsigned threads = parallelThreads();
+        if (threads == 1 || csv.size() < PARALLEL_MIN_BYTES || std::memchr(csv.data(), '"', csv.size())) {
+            CsvReader reader(csv);
+            while (reader.next(fields)) {
+                if (fields.size() < 2) continue;
+                add_edge(unescaped(fields[0]), unescaped(fields[1]));
+            }
+            return;
+        }
+        flush_edges();
+
+        // 1. Parse chunks into local dictionaries
+        std::vector<std::string_view> pieces = splitLines(csv, threads);
+        std::vector<Chunk> chunks(pieces.size());
+        parallelFor(pieces.size(), [&](size_t c) {
+            Chunk& ch = chunks[c];
+            std::vector<CsvField> f;
+            CsvReader reader(pieces[c]);
+            while (reader.next(f)) {
+                if (f.size() < 2) continue;
+                ch.add_edge(f[0].text, f[1].text);
+            }
+            ch.flush_edges();
+            ch.ref.resize(ch.names.size());
+            ch.owner.assign(ch.names.size(), 0);
+            // Bucket local ids by shard for the merge
+            ch.shard_start.assign(NAME_SHARDS + 1, 0);
+            for (uint64_t h : ch.hashes) ++ch.shard_start[shard(h) + 1];
+            for (size_t s = 0; s < NAME_SHARDS; ++s) ch.shard_start[s + 1] += ch.shard_start[s];
+            std::vector<uint32_t> next(ch.shard_start.begin(), ch.shard_start.end() - 1);
+            ch.by_shard.resize(ch.names.size());
+            for (uint32_t l = 0; l < ch.names.size(); ++l) ch.by_shard[next[shard(ch.hashes[l])]++] = l;
+        });
+
+        // 2. Merge into the shards; a new name gets a pending entry
+        std::vector<Pending> pending(NAME_SHARDS);
+        parallelFor(NAME_SHARDS, [&](size_t s) {
+            Pending& p = pending[s];
+            for (Chunk& ch : chunks) {
+                for (uint32_t i = ch.shard_start[s]; i < ch.shard_start[s + 1]; ++i) {
+                    uint32_t l = ch.by_shard[i];
+                    uint64_t h = ch.hashes[l];
+                    uint32_t g = index_[s].find(ch.names[l], h, names_);
+                    if (g != UINT32_MAX) {
+                        ch.ref[l] = g;
+                        continue;
+                    }
+                    uint32_t fresh = static_cast<uint32_t>(p.names.size());
+                    uint32_t e = p.index.insert(ch.names[l], h, fresh, p.names);
+                    if (e == fresh) {
+                        p.names.push_back(ch.names[l]);
+                        p.hashes.push_back(h);
+                        ch.owner[l] = 1;
+                    }
+                    ch.ref[l] = e;
+                    ch.owner[l] |= 2;   // ref is a pending entry
+                }
+            }
+            p.global.resize(p.names.size());
+        });
+
+        // 3. Number new names in first-appearance order
+        std::vector<uint32_t> first_id(chunks.size() + 1, static_cast<uint32_t>(names_.size()));
+        std::vector<size_t> first_edge(chunks.size() + 1, edge_src_.size());
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            uint32_t owned = 0;
+            for (uint8_t o : chunks[c].owner) owned += o & 1;
+            first_id[c + 1] = first_id[c] + owned;
+            first_edge[c + 1] = first_edge[c] + chunks[c].src.size();
+        }
+        names_.resize(first_id.back());
+        labels_.resize(first_id.back());
+        declared_.resize(first_id.back(), 0);
+        edge_src_.resize(first_edge.back());
+        edge_dst_.resize(first_edge.back());
+        parallelFor(chunks.size(), [&](size_t c) {
+            Chunk& ch = chunks[c];
+            uint32_t id = first_id[c];
+            for (uint32_t l = 0; l < ch.names.size(); ++l) {
+                if (!(ch.owner[l] & 1)) continue;
+                pending[shard(ch.hashes[l])].global[ch.ref[l]] = id;
+                names_[id++] = ch.names[l];
+            }
+        });
+        parallelFor(chunks.size(), [&](size_t c) {
+            Chunk& ch = chunks[c];
+            for (uint32_t l = 0; l < ch.names.size(); ++l)
+                if (ch.owner[l] & 2) ch.ref[l] = pending[shard(ch.hashes[l])].global[ch.ref[l]];
+            size_t at = first_edge[c];
+            for (size_t i = 0; i < ch.src.size(); ++i, ++at) {
+                edge_src_[at] = ch.ref[ch.src[i]];
+                edge_dst_[at] = ch.ref[ch.dst[i]];
+            }
+        });
+        parallelFor(NAME_SHARDS, [&](size_t s) {
+            Pending& p = pending[s];
+            for (size_t e = 0; e < p.names.size(); ++e) index_[s].insert(p.names[e], p.hashes[e], p.global[e], names_);
+        });
+    }
+
+    // The accessors below are valid after build() or open_snapshot()
+    size_t num_nodes() const { return snapshot_ ? nodes_ : names_.size(); }
+    size_t num_edges() const { return edges_; }
+    bool from_snapshot() const { return snapshot_ != nullptr; }
+
+    std::string_view name(uint32_t v) const {
+        if (!snapshot_) return names_[v];
+        return std::string_view(strings_ + name_offsets_view_[v], name_offsets_view_[v + 1] - name_offsets_view_[v]);
+    }
+    std::string_view label(uint32_t v) const {
+        if (!snapshot_) return labels_[v];
+        return std::string_view(strings_ + label_offsets_view_[v], label_offsets_view_[v + 1] - label_offsets_view_[v]);
+    }
+    bool declared(uint32_t v) const { return declared_view_[v] != 0; }
+
+    Range out(uint32_t v) const {
+        return Range{out_targets_view_ + out_offsets_view_[v], out_targets_view_ + out_offsets_view_[v + 1]};
+    }
+    Range in(uint32_t v) const {
+        return Range{in_sources_view_ + in_offsets_view_[v], in_sources_view_ + in_offsets_view_[v + 1]};
+    }
+
+private:
+    static const size_t EDGE_BATCH = 128;
+    static const size_t NAME_SHARDS = 64;
+    static const size_t PARALLEL_MIN_BYTES = 1 << 20;
+
+    static size_t shard(uint64_t h) { return h >> 58; }
+
+    // A chunk of load_edges() input with its own dictionary
+    struct Chunk {
+        std::vector<std::string_view> names;
+        std::vector<uint64_t> hashes;
+        NameIndex index;
+        std::vector<uint32_t> src, dst;   // chunk-local ids
+        std::vector<uint32_t> ref;        // local id -> global id (or pending entry while merging)
+        std::vector<uint8_t> owner;       // 1: first mention of a new name, 2: ref is pending
+        std::vector<uint32_t> by_shard;   // local ids grouped by shard
+        std::vector<uint32_t> shard_start;
+
+        std::vector<std::string_view> pending;
+
+        // Batched and prefetched like Graph::add_edge()
+        void add_edge(std::string_view source, std::string_view target) {
+            pending.push_back(source);
+            pending.push_back(target);
+            if (pending.size() == EDGE_BATCH * 2) flush_edges();
+        }
+
+        void flush_edges() {
+            uint64_t h[EDGE_BATCH * 2];
+            for (size_t i = 0; i < pending.size(); ++i) {
+                h[i] = hashName(pending[i]);
+                index.prefetch(h[i]);
+            }
+            for (size_t i = 0; i < pending.size(); i += 2) {
+                src.push_back(intern(pending[i], h[i]));
+                dst.push_back(intern(pending[i + 1], h[i + 1]));
+            }
+            pending.clear();
+        }
+
+        uint32_t intern(std::string_view name, uint64_t h) {
+            uint32_t fresh = static_cast<uint32_t>(names.size());
+            uint32_t id = index.insert(name, h, fresh, names);
+            if (id == fresh) {
+                names.push_back(name);
+                hashes.push_back(h);
+            }
+            return id;
+        }
+    };
+
+    // New names met by one shard during a merge
+    struct Pending {
+        std::vector<std::string_view> names;
+        std::vector<uint64_t> hashes;
+        NameIndex index;
+        std::vector<uint32_t> global;
+    };
+
+    uint32_t intern(std::string_view name, uint64_t h) {
+        uint32_t fresh = static_cast<uint32_t>(names_.size());
+        uint32_t id = index_[shard(h)].insert(name, h, fresh, names_);
+        if (id == fresh) {
+            names_.push_back(name);
+            labels_.emplace_back();
+            declared_.push_back(0);
+        }
+        return id;
+    }
+
+    void flush_edges() {
+        if (pending_.empty()) return;
+        uint64_t hashes[EDGE_BATCH * 2];
+        for (size_t i = 0; i < pending_.size(); ++i) {
+            hashes[i] = hashName(pending_[i]);
+            index_[shard(hashes[i])].prefetch(hashes[i]);
+        }
+        for (size_t i = 0; i < pending_.size(); i += 2) {
+            edge_src_.push_back(intern(pending_[i], hashes[i]));
+            edge_dst_.push_back(intern(pending_[i + 1], hashes[i + 1]));
+        }
+        pending_.clear();
+    }
+
+    // Stable counting sort of (key, value) pairs by key into offsets/values
+    static void count_sort(const std::vector<uint32_t>& keys, const std::vector<uint32_t>& vals, size_t n,
+                           std::vector<uint64_t>& offsets, std::vector<uint32_t>& out) {
+        offsets.assign(n + 1, 0);
+        for (uint32_t k : keys) ++offsets[k + 1];
+        for (size_t v = 0; v < n; ++v) offsets[v + 1] += offsets[v];
+        out.resize(keys.size());
+        std::vector<uint64_t> next(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < keys.size(); ++i) out[next[keys[i]]++] = vals[i];
+    }
+
+    std::vector<NameIndex> index_ = std::vector<NameIndex>(NAME_SHARDS);
+    std::vector<std::string_view> names_, labels_;
+    std::vector<uint8_t> declared_;
+    std::deque<std::string> owned_;
+
+    // Edge list, only until build()
+    std::vector<std::string_view> pending_;
+    std::vector<uint32_t> edge_src_, edge_dst_;
+
+    std::vector<uint64_t> out_offsets_, in_offsets_;
+    std::vector<uint32_t> out_targets_, in_sources_;
+
+    // What the accessors read: the arrays above after build(), or the
+    // snapshot's sections
+    size_t nodes_ = 0, edges_ = 0;
+    std::unique_ptr<MappedFile> snapshot_;
+    const char* strings_ = nullptr;
+    const uint64_t* name_offsets_view_ = nullptr;
+    const uint64_t* label_offsets_view_ = nullptr;
+    const uint8_t* declared_view_ = nullptr;
+    const uint64_t* out_offsets_view_ = nullptr;
+    const uint32_t* out_targets_view_ = nullptr;
+    const uint64_t* in_offsets_view_ = nullptr;
+    const uint32_t* in_sources_view_ = nullptr;
+    const uint32_t* name_order_view_ = nullptr;   // ids sorted by name, for find()
+};
+
+#endif // GRAPH_H
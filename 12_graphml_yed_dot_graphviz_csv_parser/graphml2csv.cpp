@@ -0,0 +1,202 @@
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <getopt.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "graphml_stream.h"
+
+// One pass over a GraphML file writing nodes.csv, nodes_short.csv,
+// edges.csv and edges_short.csv, the same as running nodes and edges
+// with and without --short.
+//
+// The main thread only parses. Records go out in batches shared by four
+// writer threads, each of which formats its own file into a large buffer
+// and writes it with fwrite. A writer holds at most MAX_QUEUED batches,
+// so a slow disk stalls the parser instead of filling memory.
+
+static const size_t BATCH_RECORDS = 4096;
+static const size_t MAX_QUEUED = 8;
+static const size_t WRITE_BUFFER = 1 << 20;
+
+typedef std::vector<GraphmlRecord> Batch;
+
+class CsvWriter {
+public:
+    CsvWriter(const std::string& path, GraphmlRecord::Kind kind, bool short_ids)
+        : path_(path), kind_(kind), short_ids_(short_ids) {
+        file_ = std::fopen(path.c_str(), "wb");
+        if (!file_) return;
+        buf_.reserve(WRITE_BUFFER + 4096);
+        buf_ = kind == GraphmlRecord::NODE ? "id,label\n" : "source,target\n";
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~CsvWriter() {
+        finish();
+    }
+
+    bool ok() const { return file_ != nullptr && !failed_; }
+    const std::string& path() const { return path_; }
+
+    void push(std::shared_ptr<const Batch> batch) {
+        std::unique_lock<std::mutex> lock(mu_);
+        space_.wait(lock, [this] { return queue_.size() < MAX_QUEUED; });
+        queue_.push_back(std::move(batch));
+        ready_.notify_one();
+    }
+
+    // Flush and close; false if any write failed
+    bool finish() {
+        if (thread_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                done_ = true;
+            }
+            ready_.notify_one();
+            thread_.join();
+        }
+        if (file_) {
+            if (std::fclose(file_) != 0) failed_ = true;
+            file_ = nullptr;
+        }
+        return !failed_;
+    }
+
+private:
+    void run() {
+        for (;;) {
+            std::shared_ptr<const Batch> batch;
+            {
+                std::unique_lock<std::mutex> lock(mu_);
+                ready_.wait(lock, [this] { return !queue_.empty() || done_; });
+                if (queue_.empty()) break;
+                batch = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            space_.notify_one();
+            for (const GraphmlRecord& r : *batch) append(r);
+            if (buf_.size() >= WRITE_BUFFER) flush();
+        }
+        flush();
+    }
+
+    void append(const GraphmlRecord& r) {
+        if (r.kind != kind_) return;
+        if (kind_ == GraphmlRecord::NODE) {
+            if (r.id.empty()) return;
+            buf_ += csvField(leafID(r.id, short_ids_));
+            buf_ += ',';
+            buf_ += csvField(r.label);
+        } else {
+            // Same scope as edges: only the top-level graph's edges
+            if (r.depth != 1 || r.source.empty() || r.target.empty()) return;
+            buf_ += csvField(leafID(r.source, short_ids_));
+            buf_ += ',';
+            buf_ += csvField(leafID(r.target, short_ids_));
+        }
+        buf_ += '\n';
+    }
+
+    void flush() {
+        if (!buf_.empty() && std::fwrite(buf_.data(), 1, buf_.size(), file_) != buf_.size()) failed_ = true;
+        buf_.clear();
+    }
+
+    std::string path_;
+    GraphmlRecord::Kind kind_;
+    bool short_ids_;
+    FILE* file_ = nullptr;
+    bool failed_ = false;
+    std::string buf_;
+    std::thread thread_;
+    std::mutex mu_;
+    std::condition_variable ready_, space_;
+    std::deque<std::shared_ptr<const Batch>> queue_;
+    bool done_ = false;
+};
+
+int main(int argc, char** argv) {
+    std::string out_dir = ".";
+
+    static struct option long_options[] = {
+        {"out-dir", required_argument, 0, 'o'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    int option_index = 0;
+    while ((opt = getopt_long(argc, argv, "o:", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'o': out_dir = optarg; break;
+            default:
+                std::cerr << "Usage: " << argv[0] << " [--out-dir DIR] file.graphml\n";
+                return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        std::cerr << "Missing GraphML file argument\n";
+        return 1;
+    }
+
+    std::string filename = argv[optind];
+    GraphmlReader reader(filename);
+    if (!reader.error().empty()) {
+        std::cerr << reader.error() << "\n";
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<CsvWriter>> writers;
+    writers.emplace_back(new CsvWriter(out_dir + "/nodes.csv", GraphmlRecord::NODE, false));
+    writers.emplace_back(new CsvWriter(out_dir + "/nodes_short.csv", GraphmlRecord::NODE, true));
+    writers.emplace_back(new CsvWriter(out_dir + "/edges.csv", GraphmlRecord::EDGE, false));
+    writers.emplace_back(new CsvWriter(out_dir + "/edges_short.csv", GraphmlRecord::EDGE, true));
+    for (auto& w : writers) {
+        if (!w->ok()) {
+            std::cerr << "Cannot open file: " << w->path() << "\n";
+            return 1;
+        }
+    }
+
+    long long nodes = 0, edges = 0;
+    auto batch = std::make_shared<Batch>(BATCH_RECORDS);
+    size_t used = 0;
+    for (;;) {
+        bool more = reader.next((*batch)[used]);
+        if (more) {
+            if ((*batch)[used].kind == GraphmlRecord::NODE) ++nodes;
+            else if ((*batch)[used].depth == 1) ++edges;
+            ++used;
+        }
+        if (used == BATCH_RECORDS || (!more && used > 0)) {
+            batch->resize(used);
+            std::shared_ptr<const Batch> full = std::move(batch);
+            for (auto& w : writers) w->push(full);
+            batch = std::make_shared<Batch>(BATCH_RECORDS);
+            used = 0;
+        }
+        if (!more) break;
+    }
+
+    bool ok = true;
+    for (auto& w : writers) {
+        if (!w->finish()) {
+            std::cerr << "Write error: " << w->path() << "\n";
+            ok = false;
+        }
+    }
+    if (!reader.error().empty()) {
+        std::cerr << "Failed to read GraphML file " << filename << ": " << reader.error() << "\n";
+        return 1;
+    }
+    if (!ok) return 1;
+
+    std::cerr << nodes << " nodes, " << edges << " edges -> " << out_dir
+              << "/{nodes,nodes_short,edges,edges_short}.csv\n";
+    return 0;
+}
@@ -0,0 +1,398 @@
+#ifndef GRAPHML_STREAM_H
+#define GRAPHML_STREAM_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Streaming GraphML reader.
+//
+// Pulls <node> and <edge> records out of a GraphML file while reading it
+// in fixed-size chunks, so memory stays at one buffer no matter how big
+// the file is (tinyxml2 builds the whole DOM first). Only what the CSV
+// tools need is understood: element names, attributes, text inside
+// yEd's <y:NodeLabel>, comments, CDATA, <?...?> and <!DOCTYPE>. There is
+// no validation; a malformed file ends the stream with error() set.
+//
+// Nodes and edges of nested graphs (yEd groups) are returned too, with
+// their graph depth (1 for the top-level graph). A group node is returned
+// when its inner <graph> starts, so it comes before its members.
+//
+//     GraphmlReader reader("graph.graphml");
+//     GraphmlRecord r;
+//     while (reader.next(r)) { ... }
+//     if (!reader.error().empty()) { ... }
+
+// Return the full ID or just the leaf component if short_ids is true
+inline std::string leafID(const std::string& id, bool short_ids) {
+    if (!short_ids) return id;
+    auto pos = id.rfind("::");
+    if (pos != std::string::npos) return id.substr(pos + 2);
+    return id;
+}
+
+// Quote a CSV field only when it needs it (RFC 4180)
+inline std::string csvField(const std::string& s) {
+    if (s.find_first_of(",\"\r\n") == std::string::npos) return s;
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    out += '"';
+    return out;
+}
+
+struct GraphmlRecord {
+    enum Kind { NODE, EDGE } kind = NODE;
+    std::string id;
+    std::string label;    // nodes: text of their y:NodeLabel elements, space-separated
+    std::string source;   // edges
+    std::string target;
+    int depth = 0;        // nesting of the <graph> the record is in
+};
+
+class GraphmlReader {
+public:
+    explicit GraphmlReader(const std::string& filename, size_t chunk = 1 << 20)
+        : buf_(chunk) {
+        file_ = std::fopen(filename.c_str(), "rb");
+        if (!file_) error_ = "Cannot open file: " + filename;
+    }
+
+    ~GraphmlReader() {
+        if (file_) std::fclose(file_);
+    }
+
+    GraphmlReader(const GraphmlReader&) = delete;
+    GraphmlReader& operator=(const GraphmlReader&) = delete;
+
+    // Next node or edge in document order; false at the end or on error
+    bool next(GraphmlRecord& r) {
+        if (!file_) return false;
+        for (;;) {
+            if (pos_ == end_ && !refill()) {
+                if (error_.empty() && node_open_) error_ = "Unexpected end of file inside <node>";
+                return false;
+            }
+            if (buf_[pos_] == '<') {
+                size_t close;
+                if (!find_markup_end(close)) return false;
+                bool emitted = markup(pos_, close, r);
+                pos_ = close;
+                if (emitted) return true;
+            } else {
+                text();
+                if (!error_.empty()) return false;
+            }
+        }
+    }
+
+    const std::string& error() const { return error_; }
+    uint64_t bytes_read() const { return bytes_read_; }
+
+private:
+    // Keep buf_[pos_, end_) and read more after it; false at end of file
+    bool refill() {
+        if (eof_) return false;
+        if (pos_ > 0) {
+            std::memmove(buf_.data(), buf_.data() + pos_, end_ - pos_);
+            end_ -= pos_;
+            pos_ = 0;
+        }
+        // A single token larger than the buffer: grow (labels, comments)
+        if (end_ == buf_.size()) buf_.resize(buf_.size() * 2);
+        size_t n = std::fread(buf_.data() + end_, 1, buf_.size() - end_, file_);
+        if (n == 0) {
+            eof_ = true;
+            if (std::ferror(file_)) error_ = "Read error";
+            return false;
+        }
+        end_ += n;
+        bytes_read_ += n;
+        return true;
+    }
+
+    // Find where the markup starting at pos_ ends (one past '>'),
+    // reading more of the file as needed. The scan resumes where the
+    // previous attempt stopped, with its quote and bracket state, so a
+    // long tag is not rescanned.
+    bool find_markup_end(size_t& close) {
+        size_t scanned = 0;
+        char quote = 0;
+        int brackets = 0;
+        for (;;) {
+            const char* b = buf_.data() + pos_;
+            size_t n = end_ - pos_;
+            const char* terminator = nullptr;
+            if (starts_with(b, n, "<!--")) terminator = "-->";
+            else if (starts_with(b, n, "<![CDATA[")) terminator = "]]>";
+            else if (starts_with(b, n, "<?")) terminator = "?>";
+            if (n >= 9 || (n >= 2 && b[1] != '!' && b[1] != '?') || terminator) {
+                if (terminator) {
+                    size_t tl = std::strlen(terminator);
+                    for (size_t i = std::max(scanned, size_t(1)); i + tl <= n; ++i) {
+                        if (std::memcmp(b + i, terminator, tl) == 0) {
+                            close = pos_ + i + tl;
+                            return true;
+                        }
+                    }
+                    scanned = n >= tl ? n - tl + 1 : 0;
+                } else {
+                    // '>' outside attribute quotes ends a tag or <!DOCTYPE ...>
+                    for (size_t i = std::max(scanned, size_t(1)); i < n; ++i) {
+                        char c = b[i];
+                        if (quote) {
+                            if (c == quote) quote = 0;
+                        } else if (c == '"' || c == '\'') {
+                            quote = c;
+                        } else if (c == '[') {
+                            ++brackets;
+                        } else if (c == ']') {
+                            --brackets;
+                        } else if (c == '>' && brackets <= 0) {
+                            close = pos_ + i + 1;
+                            return true;
+                        }
+                    }
+                    scanned = n;
+                }
+            }
+            if (!refill()) {
+                if (error_.empty()) error_ = "Unexpected end of file inside markup";
+                return false;
+            }
+        }
+    }
+
+    static bool starts_with(const char* b, size_t n, const char* prefix) {
+        size_t pl = std::strlen(prefix);
+        return n >= pl && std::memcmp(b, prefix, pl) == 0;
+    }
+
+    // Character data up to the next '<'. Only y:NodeLabel text is kept;
+    // anything else is skipped without buffering it.
+    void text() {
+        if (!capture_ || label_depth_ != 1) {
+            const char* b = buf_.data() + pos_;
+            const char* lt = static_cast<const char*>(std::memchr(b, '<', end_ - pos_));
+            pos_ = lt ? lt - buf_.data() : end_;
+            return;
+        }
+        for (;;) {
+            const char* b = buf_.data() + pos_;
+            const char* lt = static_cast<const char*>(std::memchr(b, '<', end_ - pos_));
+            if (lt) {
+                decode(b, lt, label_);
+                pos_ = lt - buf_.data();
+                return;
+            }
+            if (!refill()) {
+                if (error_.empty()) error_ = "Unexpected end of file inside <y:NodeLabel>";
+                return;
+            }
+        }
+    }
+
+    // Handle the markup in buf_[b, e); true if it completed a record
+    bool markup(size_t b, size_t e, GraphmlRecord& r) {
+        const char* p = buf_.data() + b;
+        const char* end = buf_.data() + e;
+        if (p[1] == '!' || p[1] == '?') {
+            // CDATA counts as label text; comments, PIs and DOCTYPE are skipped
+            if (capture_ && label_depth_ == 1 && starts_with(p, end - p, "<![CDATA["))
+                label_.append(p + 9, end - 3);
+            return false;
+        }
+
+        bool closing = p[1] == '/';
+        const char* name = p + (closing ? 2 : 1);
+        const char* name_end = name;
+        while (name_end < end && !is_space(*name_end) && *name_end != '/' && *name_end != '>') ++name_end;
+        bool self_closing = !closing && end - 2 >= name_end && end[-2] == '/';
+
+        // Compare local names: yEd uses the y: prefix, GraphML none
+        const char* local = name;
+        for (const char* q = name; q < name_end; ++q)
+            if (*q == ':') local = q + 1;
+        std::string_view lname(local, name_end - local);
+
+        if (closing) {
+            if (capture_) {
+                if (--label_depth_ == 0) end_label();
+                return false;
+            }
+            if (lname == "graph") --graph_depth_;
+            if (lname == "node" && node_open_) return emit_node(r);
+            return false;
+        }
+
+        if (capture_) {
+            if (!self_closing) ++label_depth_;
+            return false;
+        }
+        if (lname == "node") {
+            node_id_.clear();
+            node_label_.clear();
+            attributes(name_end, end, [&](const std::string& k, std::string& v) {
+                if (k == "id") node_id_.swap(v);
+            });
+            node_open_ = true;
+            if (self_closing) return emit_node(r);
+            return false;
+        }
+        if (lname == "graph") {
+            // Group node: return it before its members
+            bool group = node_open_ && emit_node(r);
+            if (!self_closing) ++graph_depth_;
+            return group;
+        }
+        if (lname == "NodeLabel" && node_open_ && !self_closing) {
+            capture_ = true;
+            label_depth_ = 1;
+            label_.clear();
+            return false;
+        }
+        if (lname == "edge") {
+            r.kind = GraphmlRecord::EDGE;
+            r.id.clear();
+            r.label.clear();
+            r.source.clear();
+            r.target.clear();
+            r.depth = graph_depth_;
+            attributes(name_end, end, [&](const std::string& k, std::string& v) {
+                if (k == "id") r.id.swap(v);
+                else if (k == "source") r.source.swap(v);
+                else if (k == "target") r.target.swap(v);
+            });
+            return true;
+        }
+        return false;
+    }
+
+    void end_label() {
+        capture_ = false;
+        size_t first = label_.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos) return;
+        size_t last = label_.find_last_not_of(" \t\r\n");
+        if (!node_label_.empty()) node_label_ += ' ';
+        node_label_.append(label_, first, last - first + 1);
+    }
+
+    bool emit_node(GraphmlRecord& r) {
+        r.kind = GraphmlRecord::NODE;
+        r.id.swap(node_id_);
+        r.label.swap(node_label_);
+        r.source.clear();
+        r.target.clear();
+        r.depth = graph_depth_;
+        node_id_.clear();
+        node_label_.clear();
+        node_open_ = false;
+        return true;
+    }
+
+    // Call f(name, decoded value) for each attribute in [p, end)
+    template <typename F>
+    void attributes(const char* p, const char* end, F f) {
+        std::string key, value;
+        while (p < end) {
+            while (p < end && (is_space(*p) || *p == '/' || *p == '>')) ++p;
+            const char* k = p;
+            while (p < end && *p != '=' && !is_space(*p) && *p != '>') ++p;
+            if (p == k) break;
+            key.assign(k, p);
+            while (p < end && is_space(*p)) ++p;
+            if (p >= end || *p != '=') continue;
+            ++p;
+            while (p < end && is_space(*p)) ++p;
+            if (p >= end || (*p != '"' && *p != '\'')) break;
+            char quote = *p++;
+            const char* v = p;
+            while (p < end && *p != quote) ++p;
+            value.clear();
+            decode(v, p, value);
+            ++p;
+            f(key, value);
+        }
+    }
+
+    static bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    // Append [p, end) to out with the XML entities and character references decoded
+    static void decode(const char* p, const char* end, std::string& out) {
+        while (p < end) {
+            const char* amp = static_cast<const char*>(std::memchr(p, '&', end - p));
+            if (!amp) {
+                out.append(p, end);
+                return;
+            }
+            out.append(p, amp);
+            const char* semi = static_cast<const char*>(std::memchr(amp, ';', std::min<ptrdiff_t>(end - amp, 12)));
+            if (!semi) {
+                out += '&';
+                p = amp + 1;
+                continue;
+            }
+            std::string ent(amp + 1, semi);
+            if (ent == "lt") out += '<';
+            else if (ent == "gt") out += '>';
+            else if (ent == "amp") out += '&';
+            else if (ent == "quot") out += '"';
+            else if (ent == "apos") out += '\'';
+            else if (ent.size() > 1 && ent[0] == '#') {
+                unsigned long cp = ent[1] == 'x' ? std::strtoul(ent.c_str() + 2, nullptr, 16)
+                                                 : std::strtoul(ent.c_str() + 1, nullptr, 10);
+                append_utf8(cp, out);
+            } else {
+                out.append(amp, semi + 1);   // unknown entity: keep as is
+            }
+            p = semi + 1;
+        }
+    }
+
+    static void append_utf8(unsigned long cp, std::string& out) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    FILE* file_ = nullptr;
+    std::vector<char> buf_;
+    size_t pos_ = 0, end_ = 0;
+    bool eof_ = false;
+    uint64_t bytes_read_ = 0;
+    std::string error_;
+    int graph_depth_ = 0;
+
+    // The <node> being read: returned at its </node> or inner <graph>
+    bool node_open_ = false;
+    std::string node_id_, node_label_;
+
+    // Inside <y:NodeLabel>: depth counts its own nested elements
+    bool capture_ = false;
+    int label_depth_ = 0;
+    std::string label_;
+};
+
+#endif // GRAPHML_STREAM_H
@@ -0,0 +1,426 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "graph.h"
+#include "parallel.h"
+
+// Force-directed layout for csv2dot --layout / --format svg, so large
+// graphs can be drawn without Graphviz.
+//
+// Spring-electrical model after Hu 2005: every pair of nodes repels
+// with C K^2/d and every edge pulls its ends together with d^2/K, where
+// K is the natural edge length. Each round every node moves one step
+// along its net force; the step adapts to whether the total energy
+// (sum of squared forces) went up or down.
+//
+// Random starting positions leave large graphs folded over themselves,
+// so the layout is multilevel: the graph is repeatedly halved by merging
+// matched neighbours, the smallest version is laid out first, and each
+// finer level starts from the positions of its coarse nodes.
+//
+// Repulsion is approximated with a Barnes-Hut quadtree. The tree is
+// rebuilt every round, with its 16 top subtrees built in parallel. A
+// cell that is far enough away (size / distance < theta) acts as a
+// single body at its centre of mass, so a round costs O(n log n)
+// instead of O(n^2). The force pass runs in parallel blocks of nodes,
+// taken in the tree's spatial order so neighbouring walks share cache.
+// Each node's force is summed over its own adjacency by one thread,
+// without atomics. Starting positions come from a hash of the node id,
+// so a layout is the same on every run and with any number of threads.
+
+struct LayoutPoint {
+    double x, y;
+};
+
+static const size_t COARSEST_NODES = 100;   // stop coarsening below this
+static const size_t LAYOUT_ROWS = 4096;     // nodes per parallel block in layoutGraph()
+
+struct LayoutOptions {
+    unsigned iterations = 100;   // rounds on the coarsest level, half that on the others
+    double theta = 1.2;          // Barnes-Hut opening criterion
+    double edge_length = 1.0;    // K
+    double repulsion = 0.2;      // C, scales K^2/d
+    double cooling = 0.9;        // step factor when the energy rises
+};
+
+class QuadTree {
+public:
+    // Rebuild over `pts`, inserting them in `order` when given (the last
+    // spatial_order(), so cells close in space end up close in memory).
+    // Large inputs are split into the 16 squares two levels down, whose
+    // subtrees are built in parallel and then spliced together.
+    void build(const std::vector<LayoutPoint>& pts, const std::vector<uint32_t>& order) {
+        cells_.clear();
+        next_.assign(pts.size(), NO_BODY);
+        double x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+        if (!pts.empty()) {
+            x0 = x1 = pts[0].x;
+            y0 = y1 = pts[0].y;
+        }
+        for (const LayoutPoint& p : pts) {
+            x0 = std::min(x0, p.x);
+            x1 = std::max(x1, p.x);
+            y0 = std::min(y0, p.y);
+            y1 = std::max(y1, p.y);
+        }
+        const Square root{(x0 + x1) / 2, (y0 + y1) / 2, std::max(x1 - x0, y1 - y0) / 2 + 1e-9};
+        auto each = [&](auto f) {
+            if (order.size() == pts.size()) {
+                for (uint32_t i : order) f(i);
+            } else {
+                for (uint32_t i = 0; i < pts.size(); ++i) f(i);
+            }
+        };
+
+        if (pts.size() < PARALLEL_BUILD_MIN) {
+            cells_.push_back(Cell::make(root.half));
+            each([&](uint32_t i) { insert(cells_, root, pts, i); });
+            return;
+        }
+
+        // Cells 0 (root), 1-4 and 5-20 are fixed; subtree s hangs from cell 5 + s
+        std::vector<std::vector<uint32_t>> bodies(16);
+        each([&](uint32_t i) {
+            uint32_t q = root.quadrant(pts[i]);
+            bodies[q * 4 + root.sub(q).quadrant(pts[i])].push_back(i);
+        });
+        std::vector<std::vector<Cell>> parts(16);
+        parallelFor(16, [&](size_t s) {
+            Square sq = root.sub(static_cast<uint32_t>(s / 4)).sub(static_cast<uint32_t>(s % 4));
+            parts[s].push_back(Cell::make(sq.half));
+            for (uint32_t i : bodies[s]) insert(parts[s], sq, pts, i);
+        });
+
+        cells_.resize(21);
+        cells_[0] = Cell::make(root.half);
+        cells_[0].child = 1;
+        for (uint32_t q = 0; q < 4; ++q) {
+            cells_[1 + q] = Cell::make(root.half / 2);
+            cells_[1 + q].child = 5 + 4 * q;
+        }
+        for (size_t s = 0; s < 16; ++s) {
+            // Local index j > 0 moves to base + j - 1; local 0 is cell 5 + s
+            uint32_t base = static_cast<uint32_t>(cells_.size());
+            for (Cell& c : parts[s]) {
+                if (c.child != NO_CHILD) c.child += base - 1;
+            }
+            cells_[5 + s] = parts[s][0];
+            cells_.insert(cells_.end(), parts[s].begin() + 1, parts[s].end());
+        }
+        for (uint32_t at : {1u, 2u, 3u, 4u, 0u}) {
+            Cell& c = cells_[at];
+            double mass = 0, x = 0, y = 0;
+            for (uint32_t q = 0; q < 4; ++q) {
+                const Cell& d = cells_[c.child + q];
+                mass += d.mass;
+                x += static_cast<double>(d.x) * d.mass;
+                y += static_cast<double>(d.y) * d.mass;
+            }
+            c.mass = static_cast<float>(mass);
+            c.x = mass > 0 ? static_cast<float>(x / mass) : 0;
+            c.y = mass > 0 ? static_cast<float>(y / mass) : 0;
+        }
+    }
+
+    // Approximate repulsion K^2/d on body `i` at `p` from all other bodies
+    LayoutPoint repulsion(uint32_t i, LayoutPoint p, double k2, double theta2) const {
+        double fx = 0, fy = 0;
+        uint32_t stack[4 * MAX_DEPTH + 4];
+        size_t top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Cell& c = cells_[stack[--top]];
+            double dx = p.x - c.x, dy = p.y - c.y;
+            double d2 = dx * dx + dy * dy;
+            if (c.child == NO_CHILD || c.size2 < theta2 * d2) {
+                if (c.child == NO_CHILD && c.body == i && c.mass == 1) continue;
+                if (d2 < 1e-18) continue;   // coincident: no direction to push in
+                double s = k2 * c.mass / d2;
+                fx += dx * s;
+                fy += dy * s;
+                continue;
+            }
+            for (uint32_t q = 0; q < 4; ++q)
+                if (cells_[c.child + q].mass > 0) stack[top++] = c.child + q;
+        }
+        return LayoutPoint{fx, fy};
+    }
+
+    // Bodies in depth-first leaf order, so neighbours in space are
+    // neighbours in the list (a Z-order curve)
+    void spatial_order(std::vector<uint32_t>& out) const {
+        out.clear();
+        if (cells_.empty()) return;
+        std::vector<uint32_t> stack{0};
+        while (!stack.empty()) {
+            const Cell& c = cells_[stack.back()];
+            stack.pop_back();
+            if (c.child == NO_CHILD) {
+                for (uint32_t b = c.body; b != NO_BODY; b = next_[b]) out.push_back(b);
+                continue;
+            }
+            for (uint32_t q = 4; q-- > 0;) stack.push_back(c.child + q);
+        }
+    }
+
+private:
+    static constexpr uint32_t NO_CHILD = 0;   // the root is never anyone's child
+    static constexpr uint32_t NO_BODY = UINT32_MAX;
+    static constexpr unsigned MAX_DEPTH = 48;
+    static constexpr size_t PARALLEL_BUILD_MIN = 1 << 14;
+
+    // 24 bytes, so a tree walk pulls in as few cache lines as possible;
+    // float is plenty for an approximation. A cell's square is not
+    // stored: insert() derives it on the way down.
+    struct Cell {
+        float x, y;      // centre of mass
+        float mass;      // bodies below
+        float size2;     // (side length)^2, for the opening test
+        uint32_t child;  // first of 4 consecutive children, or NO_CHILD for a leaf
+        uint32_t body;   // a leaf's first body (more in next_), or NO_BODY
+
+        static Cell make(double half) {
+            return Cell{0, 0, 0, static_cast<float>(4 * half * half), NO_CHILD, NO_BODY};
+        }
+
+        // Running mean, so no sums need to be kept in wider types
+        void add(LayoutPoint p) {
+            mass += 1;
+            x += (static_cast<float>(p.x) - x) / mass;
+            y += (static_cast<float>(p.y) - y) / mass;
+        }
+    };
+
+    struct Square {
+        double cx, cy, half;
+
+        uint32_t quadrant(LayoutPoint p) const { return (p.x >= cx ? 1 : 0) | (p.y >= cy ? 2 : 0); }
+        Square sub(uint32_t q) const {
+            double h = half / 2;
+            return Square{q & 1 ? cx + h : cx - h, q & 2 ? cy + h : cy - h, h};
+        }
+    };
+
+    // Add body i to the tree in `cells` covering `sq`
+    void insert(std::vector<Cell>& cells, Square sq, const std::vector<LayoutPoint>& pts, uint32_t i) {
+        const LayoutPoint p = pts[i];
+        uint32_t at = 0;
+        for (unsigned depth = 0;; ++depth) {
+            if (cells[at].child == NO_CHILD) {
+                Cell& c = cells[at];
+                if (c.mass == 0 || depth == MAX_DEPTH) {
+                    // Empty leaf, or so deep the bodies all but coincide: pile up here
+                    next_[i] = c.body;
+                    c.body = i;
+                    c.add(p);
+                    return;
+                }
+                // Occupied leaf: push its body down one level, then carry on
+                uint32_t old = c.body, first = static_cast<uint32_t>(cells.size());
+                for (uint32_t q = 0; q < 4; ++q) cells.push_back(Cell::make(sq.half / 2));
+                Cell& down = cells[first + sq.quadrant(pts[old])];
+                down.body = old;
+                down.add(pts[old]);
+                cells[at].child = first;
+                cells[at].body = NO_BODY;
+            }
+            cells[at].add(p);
+            uint32_t q = sq.quadrant(p);
+            at = cells[at].child + q;
+            sq = sq.sub(q);
+        }
+    }
+
+    std::vector<Cell> cells_;
+    std::vector<uint32_t> next_;   // next body in the same leaf
+};
+
+// Starting position of node v, uniform in a square of side `side`
+inline LayoutPoint layoutSeed(uint32_t v, double side) {
+    uint64_t z = (static_cast<uint64_t>(v) + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    const double unit = 1.0 / 4294967296.0;
+    return LayoutPoint{(z >> 32) * unit * side, (z & 0xFFFFFFFFULL) * unit * side};
+}
+
+// Undirected simple graph in CSR form: one level of the multilevel layout
+struct LayoutGraph {
+    std::vector<uint64_t> offsets{0};
+    std::vector<uint32_t> adj;
+
+    size_t size() const { return offsets.size() - 1; }
+};
+
+// Both directions of every edge, without self loops or duplicates
+inline LayoutGraph layoutGraph(const Graph& g) {
+    const size_t n = g.num_nodes();
+    LayoutGraph lg;
+    lg.offsets.resize(n + 1);
+    std::vector<std::vector<uint32_t>> rows((n + LAYOUT_ROWS - 1) / LAYOUT_ROWS);
+    parallelFor(rows.size(), [&](size_t b) {
+        std::vector<uint32_t> nbrs;
+        size_t end = std::min(n, (b + 1) * LAYOUT_ROWS);
+        for (size_t i = b * LAYOUT_ROWS; i < end; ++i) {
+            uint32_t v = static_cast<uint32_t>(i);
+            nbrs.assign(g.out(v).begin(), g.out(v).end());
+            nbrs.insert(nbrs.end(), g.in(v).begin(), g.in(v).end());
+            std::sort(nbrs.begin(), nbrs.end());
+            nbrs.erase(std::unique(nbrs.begin(), nbrs.end()), nbrs.end());
+            nbrs.erase(std::remove(nbrs.begin(), nbrs.end(), v), nbrs.end());
+            lg.offsets[i + 1] = nbrs.size();
+            rows[b].insert(rows[b].end(), nbrs.begin(), nbrs.end());
+        }
+    });
+    for (size_t v = 0; v < n; ++v) lg.offsets[v + 1] += lg.offsets[v];
+    lg.adj.reserve(lg.offsets[n]);
+    for (auto& r : rows) lg.adj.insert(lg.adj.end(), r.begin(), r.end());
+    return lg;
+}
+
+// Halve a graph by merging each node with an unmatched neighbour of
+// lowest degree; parent[v] is v's node in the result
+inline LayoutGraph coarsen(const LayoutGraph& fine, std::vector<uint32_t>& parent) {
+    const size_t n = fine.size();
+    parent.assign(n, UINT32_MAX);
+    uint32_t next = 0;
+    for (uint32_t v = 0; v < n; ++v) {
+        if (parent[v] != UINT32_MAX) continue;
+        uint32_t mate = UINT32_MAX;
+        uint64_t best = UINT64_MAX;
+        for (uint64_t i = fine.offsets[v]; i < fine.offsets[v + 1]; ++i) {
+            uint32_t u = fine.adj[i];
+            uint64_t degree = fine.offsets[u + 1] - fine.offsets[u];
+            if (parent[u] == UINT32_MAX && degree < best) {
+                best = degree;
+                mate = u;
+            }
+        }
+        parent[v] = next;
+        if (mate != UINT32_MAX) parent[mate] = next;
+        ++next;
+    }
+
+    std::vector<std::vector<uint32_t>> nbrs(next);
+    for (uint32_t v = 0; v < n; ++v) {
+        for (uint64_t i = fine.offsets[v]; i < fine.offsets[v + 1]; ++i) {
+            uint32_t pu = parent[fine.adj[i]];
+            if (pu != parent[v]) nbrs[parent[v]].push_back(pu);
+        }
+    }
+    LayoutGraph coarse;
+    coarse.offsets.resize(next + 1);
+    for (uint32_t c = 0; c < next; ++c) {
+        std::sort(nbrs[c].begin(), nbrs[c].end());
+        nbrs[c].erase(std::unique(nbrs[c].begin(), nbrs[c].end()), nbrs[c].end());
+        coarse.offsets[c + 1] = coarse.offsets[c] + nbrs[c].size();
+        coarse.adj.insert(coarse.adj.end(), nbrs[c].begin(), nbrs[c].end());
+        std::vector<uint32_t>().swap(nbrs[c]);
+    }
+    return coarse;
+}
+
+// `rounds` force-directed rounds over one level, starting from `pos` with `step`
+inline void refineLayout(const LayoutGraph& g, std::vector<LayoutPoint>& pos, unsigned rounds, double step,
+                         const LayoutOptions& opt) {
+    const size_t n = g.size();
+    const double k = opt.edge_length, ck2 = opt.repulsion * k * k, theta2 = opt.theta * opt.theta;
+    const size_t block = 1024, blocks = (n + block - 1) / block;
+    std::vector<LayoutPoint> next(n);
+    QuadTree tree;
+    std::vector<uint32_t> order;   // visiting nearby nodes together keeps their tree walks in cache
+    std::vector<double> energy(blocks);
+    double last_energy = HUGE_VAL;
+    unsigned progress = 0;
+    for (unsigned round = 0; round < rounds; ++round) {
+        tree.build(pos, order);
+        tree.spatial_order(order);
+        parallelFor(blocks, [&](size_t b) {
+            double e = 0;
+            size_t end = std::min(n, (b + 1) * block);
+            for (size_t i = b * block; i < end; ++i) {
+                uint32_t v = order[i];
+                LayoutPoint p = pos[v];
+                LayoutPoint f = tree.repulsion(v, p, ck2, theta2);
+                for (uint64_t j = g.offsets[v]; j < g.offsets[v + 1]; ++j) {
+                    const LayoutPoint& q = pos[g.adj[j]];
+                    double dx = q.x - p.x, dy = q.y - p.y;
+                    double d = std::sqrt(dx * dx + dy * dy);
+                    f.x += dx * d / k;
+                    f.y += dy * d / k;
+                }
+                double f2 = f.x * f.x + f.y * f.y;
+                if (f2 > 0) {
+                    double len = std::sqrt(f2);
+                    p.x += step * f.x / len;
+                    p.y += step * f.y / len;
+                }
+                next[v] = p;
+                e += f2;
+            }
+            energy[b] = e;
+        });
+        pos.swap(next);
+
+        // Adaptive step: shrink it when the system heats up, grow it again
+        // after a run of rounds that cooled it
+        double total = 0;
+        for (double e : energy) total += e;
+        if (total < last_energy) {
+            if (++progress >= 5) {
+                progress = 0;
+                step /= opt.cooling;
+            }
+        } else {
+            progress = 0;
+            step *= opt.cooling;
+        }
+        last_energy = total;
+    }
+}
+
+// Multilevel layout: coarsen until the graph is small or stops
+// shrinking, lay out the coarsest level from hashed positions, then
+// place every node of the next finer level where its coarse node
+// ended up (spread out so the extra nodes fit) and refine from there
+inline std::vector<LayoutPoint> forceLayout(const Graph& g, const LayoutOptions& opt = LayoutOptions()) {
+    const double k = opt.edge_length;
+    std::vector<LayoutGraph> levels;
+    std::vector<std::vector<uint32_t>> parents;
+    levels.push_back(layoutGraph(g));
+    while (levels.back().size() > COARSEST_NODES) {
+        std::vector<uint32_t> parent;
+        LayoutGraph coarse = coarsen(levels.back(), parent);
+        if (coarse.size() > levels.back().size() * 3 / 4) break;   // mostly unmatched: stars, isolated nodes
+        parents.push_back(std::move(parent));
+        levels.push_back(std::move(coarse));
+    }
+
+    const size_t top = levels.size() - 1;
+    const double side = k * std::sqrt(static_cast<double>(levels[top].size()) + 1);
+    std::vector<LayoutPoint> pos(levels[top].size());
+    for (uint32_t v = 0; v < pos.size(); ++v) pos[v] = layoutSeed(v, side);
+    refineLayout(levels[top], pos, opt.iterations, k, opt);
+
+    for (size_t l = top; l-- > 0;) {
+        const std::vector<uint32_t>& parent = parents[l];
+        const double grow = std::sqrt(static_cast<double>(levels[l].size()) / levels[l + 1].size());
+        std::vector<LayoutPoint> fine(levels[l].size());
+        for (uint32_t v = 0; v < fine.size(); ++v) {
+            // A small hashed offset separates the two halves of a merged pair
+            LayoutPoint jitter = layoutSeed(v, 0.2 * k);
+            fine[v] = LayoutPoint{pos[parent[v]].x * grow + jitter.x - 0.1 * k, pos[parent[v]].y * grow + jitter.y - 0.1 * k};
+        }
+        pos.swap(fine);
+        levels.pop_back();
+        refineLayout(levels[l], pos, std::max(1u, opt.iterations / 2), 0.5 * k, opt);
+    }
+    return pos;
+}
+
+#endif // LAYOUT_H
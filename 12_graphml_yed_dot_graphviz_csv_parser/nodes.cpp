@@ -1,17 +1,7 @@
-#include <tinyxml2.h>
 #include <iostream>
 #include <string>
 #include <getopt.h>
-
-using namespace tinyxml2;
-
-// Return the full ID or just the leaf component if short_ids is true
-std::string leafID(const std::string& id, bool short_ids) {
-    if (!short_ids) return id;
-    auto pos = id.rfind("::");
-    if (pos != std::string::npos) return id.substr(pos + 2);
-    return id;
-}
+#include "graphml_stream.h"
 
 int main(int argc, char** argv) {
     bool short_ids = false;
@@ -41,28 +31,20 @@ int main(int argc, char** argv) {
 
     std::string filename = argv[optind];
 
-    XMLDocument doc;
-    if (doc.LoadFile(filename.c_str()) != XML_SUCCESS) {
-        std::cerr << "Failed to load XML file: " << filename << "\n";
-        return 1;
-    }
+    GraphmlReader reader(filename);
+    GraphmlRecord r;
 
-    XMLElement* root = doc.RootElement();
-    if (!root) {
-        std::cerr << "Invalid GraphML file\n";
-        return 1;
-    }
-
-    std::cout << "source,target\n";
+    std::ios::sync_with_stdio(false);
+    std::cout << "id,label\n";
 
-    for (XMLElement* graphElem = root->FirstChildElement("graph"); graphElem; graphElem = graphElem->NextSiblingElement("graph")) {
-        for (XMLElement* edgeElem = graphElem->FirstChildElement("edge"); edgeElem; edgeElem = edgeElem->NextSiblingElement("edge")) {
-            const char* source = edgeElem->Attribute("source");
-            const char* target = edgeElem->Attribute("target");
-            if (!source || !target) continue;
+    while (reader.next(r)) {
+        if (r.kind != GraphmlRecord::NODE || r.id.empty()) continue;
+        std::cout << csvField(leafID(r.id, short_ids)) << "," << csvField(r.label) << "\n";
+    }
 
-            std::cout << leafID(source, short_ids) << "," << leafID(target, short_ids) << "\n";
-        }
+    if (!reader.error().empty()) {
+        std::cerr << "Failed to read GraphML file " << filename << ": " << reader.error() << "\n";
+        return 1;
     }
 
     return 0;
@@ -0,0 +1,64 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Minimal fork-join helpers for the graph tools.
+//
+// parallelThreads() is the number of cores, or GRAPH_THREADS when set.
+// parallelFor(n, f) calls f(i) for every i in [0, n) on that many
+// threads, handing out indices one at a time, and returns when all are
+// done; with one thread it is a plain loop.
+
+inline unsigned parallelThreads() {
+    if (const char* env = std::getenv("GRAPH_THREADS")) {
+        int n = std::atoi(env);
+        if (n > 0) return static_cast<unsigned>(n);
+    }
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+template <typename F>
+void parallelFor(size_t n, F f) {
+    size_t threads = std::min<size_t>(parallelThreads(), n);
+    if (threads <= 1) {
+        for (size_t i = 0; i < n; ++i) f(i);
+        return;
+    }
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n;) f(i);
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+}
+
+// Split `data` into about `parts` pieces that each end just after a '\n'
+// (the last one at the end of data), so every line lies in one piece
+inline std::vector<std::string_view> splitLines(std::string_view data, size_t parts) {
+    std::vector<std::string_view> out;
+    size_t step = std::max<size_t>(1, data.size() / std::max<size_t>(1, parts));
+    size_t begin = 0;
+    while (begin < data.size()) {
+        size_t end = std::min(data.size(), begin + step);
+        if (end < data.size()) {
+            const void* nl = std::memchr(data.data() + end, '\n', data.size() - end);
+            end = nl ? static_cast<const char*>(nl) - data.data() + 1 : data.size();
+        }
+        out.push_back(data.substr(begin, end - begin));
+        begin = end;
+    }
+    return out;
+}
+
+#endif // PARALLEL_H
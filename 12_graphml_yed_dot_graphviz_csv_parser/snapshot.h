@@ -0,0 +1,238 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include <time.h>
+
+// On-disk format of graph snapshots (<edges.csv>.snap, see Graph).
+//
+// A fixed header followed by 8-byte aligned sections that are the
+// Graph's arrays verbatim, so opening one is a single mmap and the
+// arrays are used in place. Native byte order; the magic and version
+// reject anything else.
+//
+// The header records the size, inode and nanosecond mtime and ctime of
+// both source CSVs (and a hash of the nodes file's path); a snapshot
+// whose sources changed is ignored and rewritten. File times only move
+// once per clock tick (or second, on some filesystems), so sources
+// changed within SNAPSHOT_RACY_NS of being read are not snapshotted: a
+// rewrite of the same size in the same tick would go unnoticed.
+//
+// The header has its own checksum, checked on every open, and the CSR
+// arrays are bounds-checked, so a damaged file is rebuilt rather than
+// read out of bounds. Each section has a checksum too, checked only on
+// request (csv2dot --verify-snapshot) since that reads the whole file.
+
+static const char SNAPSHOT_MAGIC[8] = {'C', 'S', 'V', 'G', 'R', 'A', 'P', 'H'};
+static const uint32_t SNAPSHOT_VERSION = 3;
+static const uint64_t SNAPSHOT_RACY_NS = 2000000000;
+
+enum SnapshotSection {
+    SNAP_STRINGS,         // names, then labels, back to back
+    SNAP_NAME_OFFSETS,    // uint64 [n + 1] into SNAP_STRINGS
+    SNAP_LABEL_OFFSETS,   // uint64 [n + 1]
+    SNAP_DECLARED,        // uint8 [n]
+    SNAP_OUT_OFFSETS,     // uint64 [n + 1]
+    SNAP_OUT_TARGETS,     // uint32 [m]
+    SNAP_IN_OFFSETS,      // uint64 [n + 1]
+    SNAP_IN_SOURCES,      // uint32 [m]
+    SNAP_NAME_ORDER,      // uint32 [n], ids sorted by name (since version 2)
+    SNAP_SECTIONS
+};
+
+// What a snapshot remembers of one source file (times in nanoseconds)
+struct SnapshotFile {
+    uint64_t size, mtime, ctime, inode, device;
+
+    bool operator==(const SnapshotFile& o) const {
+        return size == o.size && mtime == o.mtime && ctime == o.ctime && inode == o.inode && device == o.device;
+    }
+};
+
+struct SnapshotSources {
+    SnapshotFile nodes, edges;
+    uint64_t nodes_path;
+
+    bool operator==(const SnapshotSources& o) const {
+        return nodes == o.nodes && edges == o.edges && nodes_path == o.nodes_path;
+    }
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sections;
+    SnapshotSources sources;
+    uint64_t num_nodes;
+    uint64_t num_edges;
+    struct {
+        uint64_t offset;
+        uint64_t bytes;
+        uint64_t checksum;
+    } section[SNAP_SECTIONS];
+    uint64_t header_checksum;   // of all the fields above
+};
+
+// 64-bit checksum of a byte stream fed in pieces of any size
+class Checksum {
+public:
+    void update(const void* data, size_t n) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        total_ += n;
+        while (n > 0 && fill_ > 0) {
+            byte(*p++);
+            --n;
+        }
+        for (; n >= 8; p += 8, n -= 8) {
+            uint64_t w;
+            std::memcpy(&w, p, 8);
+            mix(w);
+        }
+        while (n > 0) {
+            byte(*p++);
+            --n;
+        }
+    }
+
+    uint64_t value() const {
+        uint64_t h = (h_ ^ buf_ ^ total_) * K;
+        h ^= h >> 32;
+        h *= 0xD6E8FEB86659FD93ULL;
+        return h ^ (h >> 32);
+    }
+
+private:
+    static const uint64_t K = 0x9E3779B97F4A7C15ULL;
+
+    void mix(uint64_t w) {
+        h_ = (h_ ^ w) * K;
+        h_ ^= h_ >> 29;
+    }
+
+    void byte(unsigned char c) {
+        buf_ |= static_cast<uint64_t>(c) << (8 * fill_);
+        if (++fill_ == 8) {
+            mix(buf_);
+            buf_ = 0;
+            fill_ = 0;
+        }
+    }
+
+    uint64_t h_ = 0, buf_ = 0, total_ = 0;
+    int fill_ = 0;
+};
+
+inline uint64_t headerChecksum(const SnapshotHeader& h) {
+    Checksum c;
+    c.update(&h, offsetof(SnapshotHeader, header_checksum));
+    return c.value();
+}
+
+inline uint64_t snapshotNanos(const struct timespec& t) {
+    return static_cast<uint64_t>(t.tv_sec) * 1000000000ULL + static_cast<uint64_t>(t.tv_nsec);
+}
+
+inline SnapshotFile snapshotFile(const struct stat& st) {
+    SnapshotFile f;
+    f.size = static_cast<uint64_t>(st.st_size);
+    f.mtime = snapshotNanos(st.st_mtim);
+    f.ctime = snapshotNanos(st.st_ctim);
+    f.inode = static_cast<uint64_t>(st.st_ino);
+    f.device = static_cast<uint64_t>(st.st_dev);
+    return f;
+}
+
+// Identity of the CSVs a snapshot is built from; false if either is
+// missing. `racy` is set if either changed too recently to be told apart
+// from a rewrite in the same clock tick.
+inline bool snapshotSources(const std::string& nodes_file, const std::string& edges_file, SnapshotSources& out,
+                            bool& racy) {
+    struct stat ns, es;
+    if (::stat(nodes_file.c_str(), &ns) != 0 || ::stat(edges_file.c_str(), &es) != 0) return false;
+    out.nodes = snapshotFile(ns);
+    out.edges = snapshotFile(es);
+    struct timespec now;
+    ::clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t newest = std::max({out.nodes.mtime, out.nodes.ctime, out.edges.mtime, out.edges.ctime});
+    racy = newest + SNAPSHOT_RACY_NS > snapshotNanos(now);
+    Checksum path;
+    path.update(nodes_file.data(), nodes_file.size());
+    out.nodes_path = path.value();
+    return true;
+}
+
+// Writes a snapshot section by section, padding each to 8 bytes and
+// checksumming it; finish() goes back and writes the header
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path) {
+        file_ = std::fopen(path.c_str(), "wb");
+        if (!file_) return;
+        std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+        std::memset(&header_, 0, sizeof(header_));
+        std::fwrite(&header_, sizeof(header_), 1, file_);   // placeholder
+        offset_ = sizeof(header_);
+        pad();
+    }
+
+    ~SnapshotWriter() {
+        if (file_) std::fclose(file_);
+    }
+
+    bool ok() const { return file_ != nullptr && !failed_; }
+
+    void begin(SnapshotSection s) {
+        current_ = s;
+        header_.section[s].offset = offset_;
+        sum_ = Checksum();
+    }
+
+    void write(const void* data, size_t n) {
+        if (n && std::fwrite(data, 1, n, file_) != n) failed_ = true;
+        sum_.update(data, n);
+        offset_ += n;
+    }
+
+    void end() {
+        header_.section[current_].bytes = offset_ - header_.section[current_].offset;
+        header_.section[current_].checksum = sum_.value();
+        pad();
+    }
+
+    bool finish(const SnapshotSources& sources, uint64_t num_nodes, uint64_t num_edges) {
+        std::memcpy(header_.magic, SNAPSHOT_MAGIC, sizeof(header_.magic));
+        header_.version = SNAPSHOT_VERSION;
+        header_.sections = SNAP_SECTIONS;
+        header_.sources = sources;
+        header_.num_nodes = num_nodes;
+        header_.num_edges = num_edges;
+        header_.header_checksum = headerChecksum(header_);
+        if (std::fseek(file_, 0, SEEK_SET) != 0 || std::fwrite(&header_, sizeof(header_), 1, file_) != 1) failed_ = true;
+        if (std::fclose(file_) != 0) failed_ = true;
+        file_ = nullptr;
+        return !failed_;
+    }
+
+private:
+    void pad() {
+        static const char zeros[8] = {0};
+        size_t n = (8 - offset_ % 8) % 8;
+        if (n && std::fwrite(zeros, 1, n, file_) != n) failed_ = true;
+        offset_ += n;
+    }
+
+    FILE* file_ = nullptr;
+    bool failed_ = false;
+    SnapshotHeader header_;
+    uint64_t offset_ = 0;
+    SnapshotSection current_ = SNAP_STRINGS;
+    Checksum sum_;
+};
+
+#endif // SNAPSHOT_H
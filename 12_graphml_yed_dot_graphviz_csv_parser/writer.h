@@ -0,0 +1,315 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "graph.h"
+#include "layout.h"
+
+// Buffered output for csv2dot.
+//
+// Writer formats into one large buffer that goes out with a single
+// fwrite whenever it fills, instead of one ostream call per field. Each
+// escaping method makes one pass over its input, copying the runs
+// between special characters in bulk.
+//
+// writeGraph() emits a built Graph as DOT, GraphML, JSON, an edge list
+// or, given a layout (layout.h), SVG. Order is fixed by the graph, never
+// by hashing: nodes by id (nodes.csv order, then first appearance in
+// edges.csv) and edges grouped by source, in input order within a
+// source. The same input therefore always gives byte-identical output.
+
+class Writer {
+public:
+    explicit Writer(FILE* out, size_t capacity = 1 << 20) : out_(out), capacity_(capacity) {
+        buf_.reserve(capacity);
+    }
+
+    ~Writer() { flush(); }
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // False once a write has failed (closed pipe, full disk)
+    bool ok() const { return ok_; }
+
+    bool flush() {
+        if (!buf_.empty()) {
+            if (ok_ && std::fwrite(buf_.data(), 1, buf_.size(), out_) != buf_.size()) ok_ = false;
+            buf_.clear();
+        }
+        if (ok_ && std::fflush(out_) != 0) ok_ = false;
+        return ok_;
+    }
+
+    Writer& write(std::string_view s) {
+        if (buf_.size() + s.size() > capacity_) {
+            flush();
+            if (s.size() >= capacity_) {
+                if (ok_ && std::fwrite(s.data(), 1, s.size(), out_) != s.size()) ok_ = false;
+                return *this;
+            }
+        }
+        buf_.append(s.data(), s.size());
+        return *this;
+    }
+
+    Writer& put(char c) {
+        if (buf_.size() == capacity_) flush();
+        buf_ += c;
+        return *this;
+    }
+
+    Writer& number(uint64_t n) {
+        char digits[20];
+        size_t i = sizeof(digits);
+        do {
+            digits[--i] = static_cast<char>('0' + n % 10);
+            n /= 10;
+        } while (n);
+        return write(std::string_view(digits + i, sizeof(digits) - i));
+    }
+
+    Writer& number(double x, const char* format = "%.10g") {
+        char digits[32];
+        int len = std::snprintf(digits, sizeof(digits), format, x);
+        return write(std::string_view(digits, len > 0 ? static_cast<size_t>(len) : 0));
+    }
+
+    // Inside a DOT quoted string only '"' needs escaping; backslashes
+    // are left alone so labels can keep DOT's \n, \l and \r
+    Writer& dot_string(std::string_view s) {
+        size_t run = 0;
+        for (size_t i = 0; i < s.size(); ++i) {
+            if (s[i] != '"') continue;
+            write(s.substr(run, i - run)).write("\\\"");
+            run = i + 1;
+        }
+        return write(s.substr(run));
+    }
+
+    // Text or attribute value in XML
+    Writer& xml_text(std::string_view s) {
+        size_t run = 0;
+        for (size_t i = 0; i < s.size(); ++i) {
+            const char* entity;
+            switch (s[i]) {
+                case '&': entity = "&amp;"; break;
+                case '<': entity = "&lt;"; break;
+                case '>': entity = "&gt;"; break;
+                case '"': entity = "&quot;"; break;
+                default: continue;
+            }
+            write(s.substr(run, i - run)).write(entity);
+            run = i + 1;
+        }
+        return write(s.substr(run));
+    }
+
+    // Body of a JSON string (without the quotes)
+    Writer& json_string(std::string_view s) {
+        size_t run = 0;
+        for (size_t i = 0; i < s.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(s[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            write(s.substr(run, i - run));
+            switch (c) {
+                case '"': write("\\\""); break;
+                case '\\': write("\\\\"); break;
+                case '\n': write("\\n"); break;
+                case '\r': write("\\r"); break;
+                case '\t': write("\\t"); break;
+                default: {
+                    static const char hex[] = "0123456789abcdef";
+                    char u[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                    write(std::string_view(u, sizeof(u)));
+                }
+            }
+            run = i + 1;
+        }
+        return write(s.substr(run));
+    }
+
+    // A CSV field, quoted only when it needs it (RFC 4180)
+    Writer& csv_field(std::string_view s) {
+        if (s.find_first_of(",\"\r\n") == std::string_view::npos) return write(s);
+        put('"');
+        size_t run = 0;
+        for (size_t i = 0; i < s.size(); ++i) {
+            if (s[i] != '"') continue;
+            write(s.substr(run, i + 1 - run));   // the quote, then it again below
+            run = i;
+        }
+        return write(s.substr(run)).put('"');
+    }
+
+private:
+    FILE* out_;
+    size_t capacity_;
+    std::string buf_;
+    bool ok_ = true;
+};
+
+enum GraphFormat { FORMAT_DOT, FORMAT_GRAPHML, FORMAT_JSON, FORMAT_EDGELIST, FORMAT_SVG };
+
+// Format named on the command line; false if unknown
+inline bool parseGraphFormat(std::string_view name, GraphFormat& format) {
+    if (name == "dot") format = FORMAT_DOT;
+    else if (name == "graphml") format = FORMAT_GRAPHML;
+    else if (name == "json") format = FORMAT_JSON;
+    else if (name == "edgelist") format = FORMAT_EDGELIST;
+    else if (name == "svg") format = FORMAT_SVG;
+    else return false;
+    return true;
+}
+
+// Layout units (one natural edge length) in DOT points and SVG pixels
+static const double DOT_POINTS_PER_UNIT = 72;
+static const double SVG_PIXELS_PER_UNIT = 40;
+// SVG draws text labels only up to this many nodes; beyond it they are
+// unreadable anyway and hover titles carry the names
+static const size_t SVG_LABEL_LIMIT = 2000;
+
+// DOT lists the nodes from nodes.csv with their labels; other nodes
+// appear only through their edges. With a layout every node is listed
+// with a pinned pos="x,y!", for neato -n or any pos-aware renderer.
+inline void writeDot(const Graph& g, Writer& w, const std::vector<LayoutPoint>* layout = nullptr) {
+    w.write("digraph G {\n");
+    for (uint32_t v = 0; v < g.num_nodes(); ++v) {
+        if (!g.declared(v) && !layout) continue;
+        w.write("    \"").dot_string(g.name(v)).write("\" [");
+        if (g.declared(v)) w.write("label=\"").dot_string(g.label(v)).write(layout ? "\", " : "\"");
+        if (layout) {
+            w.write("pos=\"").number((*layout)[v].x * DOT_POINTS_PER_UNIT, "%.2f").put(',');
+            w.number((*layout)[v].y * DOT_POINTS_PER_UNIT, "%.2f").write("!\"");
+        }
+        w.write("];\n");
+    }
+    for (uint32_t v = 0; v < g.num_nodes(); ++v) {
+        for (uint32_t t : g.out(v))
+            w.write("    \"").dot_string(g.name(v)).write("\" -> \"").dot_string(g.name(t)).write("\";\n");
+    }
+    w.write("}\n");
+}
+
+// yEd-flavoured GraphML: labels as y:NodeLabel, so the file opens in
+// yEd and nodes/edges/graphml2csv read it back. Every node is listed,
+// since GraphML edges must refer to declared nodes.
+inline void writeGraphml(const Graph& g, Writer& w) {
+    w.write("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n"
+            "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\""
+            " xmlns:y=\"http://www.yworks.com/xml/graphml\">\n"
+            "  <key for=\"node\" id=\"d0\" yfiles.type=\"nodegraphics\"/>\n"
+            "  <graph edgedefault=\"directed\" id=\"G\">\n");
+    for (uint32_t v = 0; v < g.num_nodes(); ++v) {
+        w.write("    <node id=\"").xml_text(g.name(v));
+        if (!g.declared(v)) {
+            w.write("\"/>\n");
+            continue;
+        }
+        w.write("\"><data key=\"d0\"><y:ShapeNode><y:NodeLabel>")
+            .xml_text(g.label(v))
+            .write("</y:NodeLabel></y:ShapeNode></data></node>\n");
+    }
+    uint64_t e = 0;
+    for (uint32_t v = 0; v < g.num_nodes(); ++v) {
+        for (uint32_t t : g.out(v)) {
+            w.write("    <edge id=\"e").number(e++).write("\" source=\"").xml_text(g.name(v));
+            w.write("\" target=\"").xml_text(g.name(t)).write("\"/>\n");
+        }
+    }
+    w.write("  </graph>\n</graphml>\n");
+}
+
+// {"nodes": [{"id", "label"?}], "edges": [{"source", "target"}]}, one
+// node or edge per line; only nodes from nodes.csv have a label
+inline void writeJson(const Graph& g, Writer& w) {
+    w.write("{\n  \"nodes\": [");
+    for (uint32_t v = 0; v < g.num_nodes(); ++v) {
+        w.write(v ? ",\n    {\"id\": \"" : "\n    {\"id\": \"").json_string(g.name(v)).put('"');
+        if (g.declared(v)) w.write(", \"label\": \"").json_string(g.label(v)).put('"');
+        w.put('}');
+    }
+    w.write(g.num_nodes() ? "\n  ],\n  \"edges\": [" : "],\n  \"edges\": [");
+    bool first = true;
+    for (uint32_t v = 0; v < g.num_nodes(); ++v) {
+        for (uint32_t t : g.out(v)) {
+            w.write(first ? "\n    {\"source\": \"" : ",\n    {\"source\": \"").json_string(g.name(v));
+            w.write("\", \"target\": \"").json_string(g.name(t)).write("\"}");
+            first = false;
+        }
+    }
+    w.write(first ? "]\n}\n" : "\n  ]\n}\n");
+}
+
+// Same layout as edges.csv
+inline void writeEdgeList(const Graph& g, Writer& w) {
+    w.write("source,target\n");
+    for (uint32_t v = 0; v < g.num_nodes(); ++v) {
+        for (uint32_t t : g.out(v)) w.csv_field(g.name(v)).put(',').csv_field(g.name(t)).put('\n');
+    }
+}
+
+// Edges as lines with arrowheads under the nodes as dots; declared
+// nodes are labelled in small graphs
+inline void writeSvg(const Graph& g, Writer& w, const std::vector<LayoutPoint>& layout) {
+    const double margin = 20, r = 3;
+    double x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    for (size_t v = 0; v < layout.size(); ++v) {
+        const LayoutPoint& p = layout[v];
+        x0 = v ? std::min(x0, p.x) : p.x;
+        x1 = v ? std::max(x1, p.x) : p.x;
+        y0 = v ? std::min(y0, p.y) : p.y;
+        y1 = v ? std::max(y1, p.y) : p.y;
+    }
+    auto sx = [&](uint32_t v) { return (layout[v].x - x0) * SVG_PIXELS_PER_UNIT + margin; };
+    auto sy = [&](uint32_t v) { return (layout[v].y - y0) * SVG_PIXELS_PER_UNIT + margin; };
+
+    w.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"");
+    w.number((x1 - x0) * SVG_PIXELS_PER_UNIT + 2 * margin, "%.0f").write("\" height=\"");
+    w.number((y1 - y0) * SVG_PIXELS_PER_UNIT + 2 * margin, "%.0f").write("\">\n");
+    w.write("  <defs><marker id=\"arrow\" viewBox=\"0 0 10 10\" refX=\"16\" refY=\"5\" markerWidth=\"6\""
+            " markerHeight=\"6\" orient=\"auto\"><path d=\"M0,0 L10,5 L0,10 z\" fill=\"#999\"/></marker></defs>\n");
+    w.write("  <g stroke=\"#999\" stroke-width=\"1\" marker-end=\"url(#arrow)\">\n");
+    for (uint32_t v = 0; v < g.num_nodes(); ++v) {
+        for (uint32_t t : g.out(v)) {
+            if (t == v) continue;
+            w.write("    <line x1=\"").number(sx(v), "%.1f").write("\" y1=\"").number(sy(v), "%.1f");
+            w.write("\" x2=\"").number(sx(t), "%.1f").write("\" y2=\"").number(sy(t), "%.1f").write("\"/>\n");
+        }
+    }
+    w.write("  </g>\n  <g fill=\"#36c\">\n");
+    for (uint32_t v = 0; v < g.num_nodes(); ++v) {
+        w.write("    <circle cx=\"").number(sx(v), "%.1f").write("\" cy=\"").number(sy(v), "%.1f");
+        w.write("\" r=\"").number(r, "%.0f").write("\"><title>").xml_text(g.name(v)).write("</title></circle>\n");
+    }
+    w.write("  </g>\n");
+    if (g.num_nodes() <= SVG_LABEL_LIMIT) {
+        w.write("  <g font-family=\"sans-serif\" font-size=\"10\">\n");
+        for (uint32_t v = 0; v < g.num_nodes(); ++v) {
+            if (!g.declared(v)) continue;
+            w.write("    <text x=\"").number(sx(v) + r + 2, "%.1f").write("\" y=\"").number(sy(v) + r, "%.1f");
+            w.write("\">").xml_text(g.label(v).empty() ? g.name(v) : g.label(v)).write("</text>\n");
+        }
+        w.write("  </g>\n");
+    }
+    w.write("</svg>\n");
+}
+
+// `layout` is needed for SVG and adds positions to DOT; other formats ignore it
+inline void writeGraph(const Graph& g, GraphFormat format, Writer& w, const std::vector<LayoutPoint>* layout = nullptr) {
+    switch (format) {
+        case FORMAT_DOT: writeDot(g, w, layout); break;
+        case FORMAT_SVG: writeSvg(g, w, *layout); break;
+        case FORMAT_GRAPHML: writeGraphml(g, w); break;
+        case FORMAT_JSON: writeJson(g, w); break;
+        case FORMAT_EDGELIST: writeEdgeList(g, w); break;
+    }
+}
+
+#endif // WRITER_H